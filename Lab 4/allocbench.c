@@ -0,0 +1,100 @@
+// Create, write and delete small files over and over, first with
+// the disk nearly empty and then with it filled until only a
+// little is free, and report the ticks each pass took.  Every
+// block a file gets has to be found in the free block bitmap, so
+// a slow allocator shows up most on the full disk.
+//
+// usage: allocbench [rounds]
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+#include "fsstat.h"
+
+#define NFILL   16   // most filler files
+#define FREE   256   // free blocks to leave
+#define NBLOCK   8   // blocks per small file
+
+static char buf[8192];
+
+static void
+fillname(char *path, int i)
+{
+  strcpy(path, "allocfill.00");
+  path[10] = '0' + i/10;
+  path[11] = '0' + i%10;
+}
+
+static void
+pass(char *what, int rounds)
+{
+  struct fsstat st;
+  int i, fd, t;
+
+  t = uptime();
+  for(i = 0; i < rounds; i++){
+    if((fd = open("allocbench.tmp", O_CREATE|O_RDWR)) < 0){
+      printf(2, "allocbench: cannot create allocbench.tmp\n");
+      exit();
+    }
+    write(fd, buf, NBLOCK*512);
+    close(fd);
+    unlink("allocbench.tmp");
+  }
+  t = uptime() - t;
+  fsstat(&st);
+  printf(1, "%s: %d files, %d ticks, %d blocks free\n", what, rounds, t,
+         st.nfreeblock);
+}
+
+// Fill the disk until about FREE blocks are left.
+// Returns how many filler files it made.
+static int
+fill(void)
+{
+  struct fsstat st;
+  char path[16];
+  int i, fd;
+
+  for(i = 0; i < NFILL; i++){
+    fillname(path, i);
+    if((fd = open(path, O_CREATE|O_RDWR)) < 0)
+      break;
+    for(;;){
+      fsstat(&st);
+      if(st.nfreeblock < FREE + sizeof(buf)/512)
+        break;
+      if(write(fd, buf, sizeof(buf)) != sizeof(buf))
+        break;
+    }
+    close(fd);
+    if(st.nfreeblock < FREE + sizeof(buf)/512)
+      return i + 1;
+  }
+  return i;
+}
+
+int
+main(int argc, char *argv[])
+{
+  char path[16];
+  int rounds, i, n;
+
+  rounds = 200;
+  if(argc > 1)
+    rounds = atoi(argv[1]);
+  if(rounds <= 0){
+    printf(2, "usage: allocbench [rounds]\n");
+    exit();
+  }
+
+  pass("free disk", rounds);
+  n = fill();
+  pass("full disk", rounds);
+  for(i = 0; i < n; i++){
+    fillname(path, i);
+    unlink(path);
+  }
+  exit();
+}
@@ -0,0 +1,54 @@
+// Write a large file sequentially, with write() calls of several
+// sizes, and report the ticks taken, the transactions committed,
+// and the blocks that went through the log and straight home.
+// File data is not logged, so only the inode, indirect and bitmap
+// blocks should show up as logged.  The file is up to MAXKB (less
+// if the largest file the file system allows is smaller).
+//
+// usage: appendbench
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+#include "fsstat.h"
+
+#define SCRATCH "appendbench.tmp"
+#define MAXKB   1024
+
+static char buf[32*1024];
+
+static void
+pass(int size)
+{
+  struct fsstat st0, st1;
+  int fd, tot, t;
+
+  if((fd = open(SCRATCH, O_CREATE|O_RDWR)) < 0){
+    printf(2, "appendbench: cannot create %s\n", SCRATCH);
+    exit();
+  }
+  fsstat(&st0);
+  t = uptime();
+  for(tot = 0; tot < MAXKB*1024; tot += size)
+    if(write(fd, buf, size) != size)
+      break;
+  close(fd);
+  t = uptime() - t;
+  fsstat(&st1);
+  unlink(SCRATCH);
+  printf(1, "%d-byte writes: %d KB, %d ticks, %d commits, "
+         "%d logged, %d written home\n", size, tot/1024, t,
+         st1.ncommit - st0.ncommit, st1.nlogwrite - st0.nlogwrite,
+         st1.ndatawrite - st0.ndatawrite);
+}
+
+int
+main(void)
+{
+  int size;
+
+  for(size = 512; size <= sizeof(buf); size *= 4)
+    pass(size);
+  exit();
+}
@@ -1,6 +1,6 @@
 // Buffer cache.
 //
-// The buffer cache is a linked list of buf structures holding
+// The buffer cache is a set of buf structures holding
 // cached copies of disk block contents.  Caching disk blocks
 // in memory reduces the number of disk reads and also provides
 // a synchronization point for disk blocks used by multiple processes.
@@ -17,79 +17,272 @@
 // * B_VALID: the buffer data has been read from the disk.
 // * B_DIRTY: the buffer data has been modified
 //     and needs to be written to disk.
+//
+// Buffers are found through a hash table keyed by (dev, blockno).
+// Each bucket has its own lock, which protects its chain and the
+// refcnt of the buffers on it, so lookups of different blocks on
+// different CPUs do not contend.  Separately, every buffer is on
+// an LRU list, under bcache.lock, used only to pick a buffer to
+// recycle.  A miss holds bcache.lock while it looks for a victim,
+// so only one process at a time changes which block a buffer
+// holds.  Lock order: bcache.lock, then bucket locks.
+//
+// Buffers are allocated from a slab cache.  binit() allows the
+// cache 1/BUFMEM of the memory free at boot, at least NBUF and at
+// most NBUFMAX buffers.  A miss adds a new buffer while there is
+// room and memory is not short, and otherwise recycles one; when
+// memory runs low, kswapd frees unused buffers with bshrink()
+// before it pages anything out.
+//
+// Buffers can all be in use at once: held by readers and writers,
+// locked for a breadahead() or bawrite() in flight, or pinned
+// B_DIRTY by the log.  So a miss that finds nothing to recycle
+// adds a buffer even if memory is short, and at maxbuf waits for
+// one to be released.  To keep that rare, readahead leaves NBUF/2
+// buffers unused, bawrite() keeps at most NAWRITE writes in
+// flight, and bshrink() never leaves fewer than NBUF/2 unused.
 
 #include "types.h"
 #include "defs.h"
 #include "param.h"
+#include "mmu.h"
 #include "spinlock.h"
 #include "sleeplock.h"
 #include "fs.h"
 #include "buf.h"
+#include "fsstat.h"
+
+struct bucket {
+  struct spinlock lock;
+  struct buf *head;   // chain through hnext
+  uint nhit;          // lookups that found their block here
+};
 
 struct {
   struct spinlock lock;
-  struct buf buf[NBUF];
+  struct kmem_cache *cache;
+  uint nbuf;          // buffers allocated
+  uint maxbuf;        // ... and the most there may be
+  uint nmiss;
+  uint nreadahead;    // blocks breadahead() started reading
+  uint nshrunk;       // buffers freed by bshrink()
+  uint nwait;         // processes in bget() waiting for a buffer
+  uint nawrite;       // bawrite()s not yet finished
 
   // Linked list of all buffers, through prev/next.
   // head.next is most recently used.
   struct buf head;
+
+  struct bucket hash[NBUFHASH];
 } bcache;
 
+static struct bucket*
+bucket(uint dev, uint blockno)
+{
+  return &bcache.hash[(dev * 31 + blockno) % NBUFHASH];
+}
+
+static void
+bufctor(void *p)
+{
+  initsleeplock(&((struct buf*)p)->lock, "buffer");
+}
+
+// Allocate a buffer and put it at the LRU end of the list,
+// hashed as block 0 of dev 0.  Caller holds bcache.lock.
+static struct buf*
+balloc(void)
+{
+  struct buf *b;
+  struct bucket *h;
+
+  if((b = kmem_cache_alloc(bcache.cache)) == 0)
+    return 0;
+  b->flags = 0;
+  b->dev = 0;
+  b->blockno = 0;
+  b->refcnt = 0;
+  h = bucket(0, 0);
+  acquire(&h->lock);
+  b->hnext = h->head;
+  h->head = b;
+  release(&h->lock);
+  b->next = &bcache.head;
+  b->prev = bcache.head.prev;
+  bcache.head.prev->next = b;
+  bcache.head.prev = b;
+  bcache.nbuf++;
+  return b;
+}
+
+// Called after kinit2(), so that all of memory is free to be
+// counted.
 void
 binit(void)
 {
-  struct buf *b;
+  struct bucket *h;
+  uint n;
 
   initlock(&bcache.lock, "bcache");
+  for(h = bcache.hash; h < &bcache.hash[NBUFHASH]; h++)
+    initlock(&h->lock, "bcache.bucket");
+  bcache.cache = kmem_cache_create("buf", sizeof(struct buf), bufctor);
 
 //PAGEBREAK!
-  // Create linked list of buffers
+  n = kfreepages() / BUFMEM * (PGSIZE / sizeof(struct buf));
+  if(n < NBUF)
+    n = NBUF;
+  if(n > NBUFMAX)
+    n = NBUFMAX;
+  bcache.maxbuf = n;
+
+  // Create linked list of buffers, starting with NBUF.
+  // bshrink() never takes the cache below that.
   bcache.head.prev = &bcache.head;
   bcache.head.next = &bcache.head;
-  for(b = bcache.buf; b < bcache.buf+NBUF; b++){
-    b->next = bcache.head.next;
-    b->prev = &bcache.head;
-    initsleeplock(&b->lock, "buffer");
-    bcache.head.next->prev = b;
-    bcache.head.next = b;
+  acquire(&bcache.lock);
+  while(bcache.nbuf < NBUF)
+    if(balloc() == 0)
+      panic("binit");
+  release(&bcache.lock);
+}
+
+// Look for block blockno of dev in h, whose lock is held.
+// If it is there, take a reference to it, unless ahead is set:
+// a readahead has nothing to do for a block already cached.
+static struct buf*
+bfind(struct bucket *h, uint dev, uint blockno, int ahead)
+{
+  struct buf *b;
+
+  for(b = h->head; b; b = b->hnext){
+    if(b->dev == dev && b->blockno == blockno){
+      if(!ahead){
+        b->refcnt++;
+        h->nhit++;
+      }
+      return b;
+    }
   }
+  return 0;
+}
+
+// Take b, whose lock is held, off h's chain.
+static void
+bunhash(struct bucket *h, struct buf *b)
+{
+  struct buf **pp;
+
+  for(pp = &h->head; *pp != b; pp = &(*pp)->hnext)
+    if(*pp == 0)
+      panic("bunhash");
+  *pp = b->hnext;
+}
+
+// Count the unused buffers, up to max.  Caller holds bcache.lock.
+// The counts are unlocked peeks, which is good enough for deciding
+// whether a readahead may have a buffer.
+static int
+bspare(int max)
+{
+  struct buf *b;
+  int n;
+
+  n = 0;
+  for(b = bcache.head.prev; b != &bcache.head && n < max; b = b->prev)
+    if(b->refcnt == 0 && (b->flags & B_DIRTY) == 0)
+      n++;
+  return n;
 }
 
 // Look through buffer cache for block on device dev.
 // If not found, allocate a buffer.
 // In either case, return locked buffer.
+// For a readahead (ahead set), return 0 instead if the block is
+// already cached or there is no buffer to spare: a readahead
+// leaves NBUF/2 unused buffers for the reads that need them now.
 static struct buf*
-bget(uint dev, uint blockno)
+bget(uint dev, uint blockno, int ahead)
 {
   struct buf *b;
+  struct bucket *h, *g;
 
-  acquire(&bcache.lock);
+  h = bucket(dev, blockno);
+  acquire(&h->lock);
+  b = bfind(h, dev, blockno, ahead);
+  release(&h->lock);
+  if(b){
+    if(ahead)
+      return 0;
+    acquiresleep(&b->lock);
+    return b;
+  }
 
-  // Is the block already cached?
-  for(b = bcache.head.next; b != &bcache.head; b = b->next){
-    if(b->dev == dev && b->blockno == blockno){
-      b->refcnt++;
-      release(&bcache.lock);
-      acquiresleep(&b->lock);
-      return b;
-    }
+  // Not cached.  Check again with bcache.lock held, since only a
+  // process holding it can add the block to the cache.
+  acquire(&bcache.lock);
+again:
+  acquire(&h->lock);
+  b = bfind(h, dev, blockno, ahead);
+  release(&h->lock);
+  if(b){
+    release(&bcache.lock);
+    if(ahead)
+      return 0;
+    acquiresleep(&b->lock);
+    return b;
   }
 
-  // Not cached; recycle an unused buffer.
+  // Add a buffer if there is room; otherwise recycle the least
+  // recently used unused one.
   // Even if refcnt==0, B_DIRTY indicates a buffer is in use
   // because log.c has modified it but not yet committed it.
+  if(bcache.nbuf < bcache.maxbuf && kfreepages() > SWAPHIGH)
+    balloc();
+  if(ahead && bspare(NBUF/2 + 1) <= NBUF/2){
+    release(&bcache.lock);
+    return 0;
+  }
   for(b = bcache.head.prev; b != &bcache.head; b = b->prev){
-    if(b->refcnt == 0 && (b->flags & B_DIRTY) == 0) {
+    if(b->refcnt != 0 || (b->flags & B_DIRTY) != 0)
+      continue;   // unlocked peek; checked again below
+    g = bucket(b->dev, b->blockno);
+    acquire(&g->lock);
+    if(b->refcnt == 0 && (b->flags & B_DIRTY) == 0){
+      bunhash(g, b);
       b->dev = dev;
       b->blockno = blockno;
       b->flags = 0;
       b->refcnt = 1;
+      release(&g->lock);
+      if(ahead)
+        bcache.nreadahead++;
+      else
+        bcache.nmiss++;
+      acquire(&h->lock);
+      b->hnext = h->head;
+      h->head = b;
+      release(&h->lock);
       release(&bcache.lock);
       acquiresleep(&b->lock);
       return b;
     }
+    release(&g->lock);
   }
-  panic("bget: no buffers");
+  if(ahead){
+    release(&bcache.lock);
+    return 0;
+  }
+
+  // Every buffer is in use: held, being written or read ahead, or
+  // pinned by the log.  Add one even if memory is short, or if
+  // the cache is as big as it may get, wait for one to come free.
+  if(bcache.nbuf < bcache.maxbuf && balloc() != 0)
+    goto again;
+  bcache.nwait++;
+  sleep(&bcache.nwait, &bcache.lock);
+  bcache.nwait--;
+  goto again;
 }
 
 // Return a locked buf with the contents of the indicated block.
@@ -98,13 +291,47 @@ bread(uint dev, uint blockno)
 {
   struct buf *b;
 
-  b = bget(dev, blockno);
+  b = bget(dev, blockno, 0);
   if((b->flags & B_VALID) == 0) {
     iderw(b);
   }
   return b;
 }
 
+// Return a locked buffer for the indicated block with its
+// contents zeroed, without reading the disk: for a block whose
+// old contents do not matter, like a newly allocated file block.
+struct buf*
+bclear(uint dev, uint blockno)
+{
+  struct buf *b;
+
+  b = bget(dev, blockno, 0);
+  memset(b->data, 0, BSIZE);
+  b->flags |= B_VALID;
+  return b;
+}
+
+// Start reading the indicated block into the cache, unless it is
+// there already, without waiting for the disk.  The buffer stays
+// locked until the read finishes, so a bread() of the block in
+// the meantime waits for it.
+void
+breadahead(uint dev, uint blockno)
+{
+  struct buf *b;
+
+  if((b = bget(dev, blockno, 1)) == 0)
+    return;
+  if(b->flags & B_VALID){
+    // Someone else read it before we got the lock.
+    brelse(b);
+    return;
+  }
+  b->flags |= B_ASYNC;
+  iderw(b);
+}
+
 // Write b's contents to disk.  Must be locked.
 void
 bwrite(struct buf *b)
@@ -115,19 +342,27 @@ bwrite(struct buf *b)
   iderw(b);
 }
 
-// Release a locked buffer.
-// Move to the head of the MRU list.
-void
-brelse(struct buf *b)
+// Drop a reference to b, whose lock has been released.
+static void
+bput(struct buf *b)
 {
-  if(!holdingsleep(&b->lock))
-    panic("brelse");
+  struct bucket *h;
 
-  releasesleep(&b->lock);
+  h = bucket(b->dev, b->blockno);
+  acquire(&h->lock);
+  if(b->refcnt > 1){
+    b->refcnt--;
+    release(&h->lock);
+    return;
+  }
+  release(&h->lock);
 
+  // Probably the last reference.  Moving b on the LRU list needs
+  // bcache.lock, which comes first; our reference keeps b from
+  // being recycled or freed meanwhile.
   acquire(&bcache.lock);
-  b->refcnt--;
-  if (b->refcnt == 0) {
+  acquire(&h->lock);
+  if (--b->refcnt == 0) {
     // no one is waiting for it.
     b->next->prev = b->prev;
     b->prev->next = b->next;
@@ -135,9 +370,162 @@ brelse(struct buf *b)
     b->prev = &bcache.head;
     bcache.head.next->prev = b;
     bcache.head.next = b;
+    if(bcache.nwait)
+      wakeup(&bcache.nwait);
+  }
+  release(&h->lock);
+  release(&bcache.lock);
+}
+
+// Start writing b's contents to disk and give b up without waiting.
+// b stays locked until the write is done, so a bread() of the
+// block waits for it.  Must be locked.  At most NAWRITE writes
+// are in flight at once, so that they cannot tie up the cache;
+// past that, wait for one to finish.
+void
+bawrite(struct buf *b)
+{
+  if(!holdingsleep(&b->lock))
+    panic("bawrite");
+  acquire(&bcache.lock);
+  while(bcache.nawrite >= NAWRITE)
+    sleep(&bcache.nawrite, &bcache.lock);
+  bcache.nawrite++;
+  release(&bcache.lock);
+  b->flags |= B_DIRTY|B_ASYNC|B_AWRITE;
+  iderw(b);
+}
+
+// Release a locked buffer.
+// Move to the head of the MRU list.
+void
+brelse(struct buf *b)
+{
+  if(!holdingsleep(&b->lock))
+    panic("brelse");
+
+  releasesleep(&b->lock);
+  bput(b);
+}
+
+// Called by the disk driver when the read breadahead() or the
+// write bawrite() started has finished: release b on behalf of
+// the process that started it.  May be called from an interrupt.
+void
+bdone(struct buf *b)
+{
+  if(b->flags & B_AWRITE){
+    acquire(&bcache.lock);
+    bcache.nawrite--;
+    wakeup(&bcache.nawrite);
+    release(&bcache.lock);
+  }
+  b->flags &= ~(B_ASYNC|B_AWRITE);
+  releasesleep(&b->lock);
+  bput(b);
+}
+
+// Free up to n unused buffers, least recently used first, but
+// keep at least NBUF, and at least NBUF/2 of them unused.  kswapd
+// calls this when memory runs low.  Returns the number freed.
+int
+bshrink(int n)
+{
+  struct buf *b, *prev, *freed;
+  struct bucket *g;
+  int i, spare;
+
+  freed = 0;
+  i = 0;
+  acquire(&bcache.lock);
+  spare = bspare(bcache.nbuf);
+  for(b = bcache.head.prev; b != &bcache.head && i < n; b = prev){
+    prev = b->prev;
+    if(bcache.nbuf <= NBUF || spare <= NBUF/2)
+      break;
+    if(b->refcnt != 0 || (b->flags & B_DIRTY) != 0)
+      continue;
+    g = bucket(b->dev, b->blockno);
+    acquire(&g->lock);
+    if(b->refcnt == 0 && (b->flags & B_DIRTY) == 0){
+      bunhash(g, b);
+      b->next->prev = b->prev;
+      b->prev->next = b->next;
+      bcache.nbuf--;
+      bcache.nshrunk++;
+      spare--;
+      b->next = freed;
+      freed = b;
+      i++;
+    }
+    release(&g->lock);
   }
-  
   release(&bcache.lock);
+
+  while((b = freed) != 0){
+    freed = b->next;
+    kmem_cache_free(bcache.cache, b);
+  }
+  return i;
+}
+
+// Empty the cache of unused blocks, as if they had never been
+// read, for benchmarks that want to measure reads from disk.
+// Frees buffers down to NBUF and invalidates the rest.  Returns
+// the number of blocks dropped.
+int
+bdrop(void)
+{
+  struct buf *b;
+  struct bucket *g, *h;
+  int n;
+
+  n = bshrink(NBUFMAX);
+  h = bucket(0, 0);
+  acquire(&bcache.lock);
+  for(b = bcache.head.next; b != &bcache.head; b = b->next){
+    if(b->refcnt != 0 || (b->flags & (B_VALID|B_DIRTY)) != B_VALID)
+      continue;
+    g = bucket(b->dev, b->blockno);
+    acquire(&g->lock);
+    if(b->refcnt != 0 || (b->flags & B_DIRTY) != 0){
+      release(&g->lock);
+      continue;
+    }
+    bunhash(g, b);
+    release(&g->lock);
+    b->dev = 0;
+    b->blockno = 0;
+    b->flags = 0;
+    acquire(&h->lock);
+    b->hnext = h->head;
+    h->head = b;
+    release(&h->lock);
+    n++;
+  }
+  release(&bcache.lock);
+  return n;
+}
+
+// Fill in the buffer cache statistics.
+void
+bstat(struct fsstat *st)
+{
+  struct bucket *h;
+
+  acquire(&bcache.lock);
+  st->nbuf = bcache.nbuf;
+  st->maxbuf = bcache.maxbuf;
+  st->nmiss = bcache.nmiss;
+  st->nreadahead = bcache.nreadahead;
+  st->nshrunk = bcache.nshrunk;
+  release(&bcache.lock);
+  st->nhit = 0;
+  for(h = bcache.hash; h < &bcache.hash[NBUFHASH]; h++){
+    acquire(&h->lock);
+    st->nhit += h->nhit;
+    release(&h->lock);
+  }
 }
 //PAGEBREAK!
 // Blank page.
@@ -6,9 +6,12 @@ struct buf {
   uint refcnt;
   struct buf *prev; // LRU cache list
   struct buf *next;
+  struct buf *hnext; // hash bucket chain
   struct buf *qnext; // disk queue
   uchar data[BSIZE];
 };
 #define B_VALID 0x2  // buffer has been read from disk
 #define B_DIRTY 0x4  // buffer needs to be written to disk
+#define B_ASYNC 0x8  // I/O started by breadahead() or bawrite(); the disk driver releases it
+#define B_AWRITE 0x10  // write started by bawrite(); counted in bcache.nawrite
 
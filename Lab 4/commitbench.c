@@ -0,0 +1,49 @@
+// Time log commits: make small appends to a file, one at a time,
+// so that each is a transaction of its own, and report the ticks
+// taken and the ticks per 100 commits.
+//
+// usage: commitbench [commits]
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+#include "fsstat.h"
+
+int
+main(int argc, char *argv[])
+{
+  struct fsstat st0, st1;
+  int i, n, fd, t, ncommit;
+  char c;
+
+  n = 500;
+  if(argc > 1)
+    n = atoi(argv[1]);
+  if(n <= 0){
+    printf(2, "usage: commitbench [commits]\n");
+    exit();
+  }
+  if((fd = open("commitbench.tmp", O_CREATE|O_RDWR)) < 0){
+    printf(2, "commitbench: cannot create file\n");
+    exit();
+  }
+
+  c = 'x';
+  fsstat(&st0);
+  t = uptime();
+  for(i = 0; i < n; i++)
+    write(fd, &c, 1);
+  t = uptime() - t;
+  fsstat(&st1);
+  close(fd);
+  unlink("commitbench.tmp");
+
+  ncommit = st1.ncommit - st0.ncommit;
+  printf(1, "%d commits, %d blocks logged, %d ticks", ncommit,
+         st1.nlogwrite - st0.nlogwrite, t);
+  if(ncommit > 0)
+    printf(1, ", %d ticks per 100 commits", t * 100 / ncommit);
+  printf(1, "\n");
+  exit();
+}
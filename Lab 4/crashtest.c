@@ -0,0 +1,102 @@
+// Test crash recovery of the file system log.
+//
+//   crashtest point
+//
+// commits a file recording point (one of LOGCRASH_* in fs.h), then
+// creates ct.file in a transaction whose commit stops the machine
+// at that point.  Boot again and run
+//
+//   crashtest
+//
+// to check what recovery left behind: ct.file must exist if and
+// only if its transaction committed, and the file system must
+// still work.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fs.h"
+#include "fcntl.h"
+
+static void
+fail(char *msg)
+{
+  printf(1, "crashtest: FAIL: %s\n", msg);
+  exit();
+}
+
+static void
+crash(int point)
+{
+  char c;
+  int fd;
+
+  if((fd = open("ct.point", O_CREATE|O_RDWR)) < 0)
+    fail("cannot create ct.point");
+  c = '0' + point;
+  write(fd, &c, 1);
+  close(fd);
+  unlink("ct.file");
+
+  if(logcrash(point) < 0)
+    fail("bad crash point");
+  printf(1, "crashtest: crashing at point %d; boot again and "
+         "run crashtest\n", point);
+  open("ct.file", O_CREATE|O_RDWR);
+  // Not reached, unless the file system had nothing to commit.
+  logcrash(0);
+  fail("did not crash");
+}
+
+static void
+check(void)
+{
+  char buf[512], c;
+  int fd, i, exists;
+
+  if((fd = open("ct.point", O_RDONLY)) < 0){
+    printf(1, "crashtest: no crash to check; run crashtest point\n");
+    exit();
+  }
+  if(read(fd, &c, 1) != 1 || c < '1' || c > '0' + LOGCRASH_NOINSTALL)
+    fail("ct.point damaged");
+  close(fd);
+
+  exists = (fd = open("ct.file", O_RDONLY)) >= 0;
+  close(fd);
+  if(c == '0' + LOGCRASH_NOINSTALL && !exists)
+    fail("committed ct.file is missing");
+  if(c != '0' + LOGCRASH_NOINSTALL && exists)
+    fail("uncommitted ct.file exists");
+
+  // The file system still works.
+  if((fd = open("ct.check", O_CREATE|O_RDWR)) < 0)
+    fail("cannot create ct.check");
+  for(i = 0; i < 8; i++){
+    memset(buf, i, sizeof(buf));
+    if(write(fd, buf, sizeof(buf)) != sizeof(buf))
+      fail("cannot write ct.check");
+  }
+  close(fd);
+  fd = open("ct.check", O_RDONLY);
+  for(i = 0; i < 8; i++){
+    if(read(fd, buf, sizeof(buf)) != sizeof(buf) || buf[0] != i ||
+       buf[sizeof(buf)-1] != i)
+      fail("ct.check reads back wrong");
+  }
+  close(fd);
+  unlink("ct.check");
+  unlink("ct.file");
+  unlink("ct.point");
+  printf(1, "crashtest: point %c OK\n", c);
+}
+
+int
+main(int argc, char *argv[])
+{
+  if(argc > 1)
+    crash(atoi(argv[1]));
+  else
+    check();
+  exit();
+}
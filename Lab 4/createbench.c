@@ -0,0 +1,63 @@
+// Create, write and delete small files, as a compiler or a shell
+// script does with temporaries, and report the ticks taken and
+// what the file system log did: a small-file workload like this
+// rewrites the same inode and bitmap blocks over and over.
+//
+// usage: createbench [files]
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+#include "fsstat.h"
+
+static char data[1024];
+
+static void
+name(char *path, int i)
+{
+  strcpy(path, "cb.000");
+  path[3] = '0' + i/100 % 10;
+  path[4] = '0' + i/10 % 10;
+  path[5] = '0' + i % 10;
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct fsstat st0, st1;
+  char path[16];
+  int i, n, fd, t;
+
+  n = 100;
+  if(argc > 1)
+    n = atoi(argv[1]);
+  if(n <= 0 || n > 1000){
+    printf(2, "usage: createbench [files], at most 1000\n");
+    exit();
+  }
+
+  fsstat(&st0);
+  t = uptime();
+  for(i = 0; i < n; i++){
+    name(path, i);
+    if((fd = open(path, O_CREATE|O_RDWR)) < 0){
+      printf(2, "createbench: cannot create %s\n", path);
+      exit();
+    }
+    write(fd, data, sizeof(data));
+    close(fd);
+  }
+  for(i = 0; i < n; i++){
+    name(path, i);
+    unlink(path);
+  }
+  t = uptime() - t;
+  fsstat(&st1);
+
+  printf(1, "%d files: %d ticks\n", n, t);
+  printf(1, "commits %d, blocks logged %d, installed %d\n",
+         st1.ncommit - st0.ncommit, st1.nlogwrite - st0.nlogwrite,
+         st1.ninstall - st0.ninstall);
+  exit();
+}
@@ -1,19 +1,33 @@
 struct buf;
 struct context;
 struct file;
+struct fsstat;
 struct inode;
+struct kmem_cache;
+struct kmemstat;
+struct memstat;
 struct pipe;
 struct proc;
 struct rtcdate;
 struct spinlock;
 struct sleeplock;
+struct shmseg;
+struct slabinfo;
 struct stat;
+struct trapframe;
 struct superblock;
 
 // bio.c
+void            bawrite(struct buf*);
+void            bdone(struct buf*);
+int             bdrop(void);
 void            binit(void);
 struct buf*     bread(uint, uint);
+struct buf*     bclear(uint, uint);
+void            breadahead(uint, uint);
 void            brelse(struct buf*);
+int             bshrink(int);
+void            bstat(struct fsstat*);
 void            bwrite(struct buf*);
 
 // console.c
@@ -36,6 +50,9 @@ int             filewrite(struct file*, char*, int n);
 
 // fs.c
 void            readsb(int dev, struct superblock *sb);
+void            ballocinit(int dev);
+void            bfreed(uint);
+void            bfreestat(struct fsstat*);
 int             dirlink(struct inode*, char*, uint);
 struct inode*   dirlookup(struct inode*, char*, uint*);
 struct inode*   ialloc(uint, short);
@@ -46,6 +63,7 @@ void            iput(struct inode*);
 void            iunlock(struct inode*);
 void            iunlockput(struct inode*);
 void            iupdate(struct inode*);
+void            istat(struct fsstat*);
 int             namecmp(const char*, const char*);
 struct inode*   namei(char*);
 struct inode*   nameiparent(char*, char*);
@@ -65,9 +83,15 @@ void            ioapicinit(void);
 
 // kalloc.c
 char*           kalloc(void);
+char*           kalloc_order(int);
+char*           kalloc_zeroed(void);
 void            kfree(char*);
+void            kfree_order(char*, int);
 void            kinit1(void*, void*);
 void            kinit2(void*, void*);
+void            kmemstat(struct kmemstat*);
+uint            kfreepages(void);
+void            kzeroinit(void);
 
 // kbd.c
 void            kbdintr(void);
@@ -84,6 +108,10 @@ void            microdelay(int);
 // log.c
 void            initlog(int dev);
 void            log_write(struct buf*);
+void            log_data(struct buf*);
+void            log_free(uint);
+void            logcrash(int);
+void            logstat(struct fsstat*);
 void            begin_op();
 void            end_op();
 
@@ -96,6 +124,7 @@ void            picenable(int);
 void            picinit(void);
 
 // pipe.c
+void            pipeinit(void);
 int             pipealloc(struct file**, struct file**);
 void            pipeclose(struct pipe*, int);
 int             piperead(struct pipe*, char*, int);
@@ -108,22 +137,53 @@ void            exit(void);
 int             fork(void);
 int             growproc(int);
 int             kill(int);
+struct proc*    kthread(char*, void (*)(void));
 struct cpu*     mycpu(void);
 struct proc*    myproc();
 void            pinit(void);
 void            procdump(void);
+int             procmemstat(int, struct memstat*);
 void            scheduler(void) __attribute__((noreturn));
 void            sched(void);
 void            setproc(struct proc*);
 void            sleep(void*, struct spinlock*);
+char*           swapvictim(uint);
 void            userinit(void);
 int             wait(void);
 void            wakeup(void*);
 void            yield(void);
 
+// swap.c
+void            swapinit(int);
+int             swapout(void);
+int             swapin(struct proc*, uint);
+void            swapread(uint, char*);
+void            swapfree(uint);
+char*           kallocswap(void);
+char*           kallocswap_zeroed(void);
+void            swapwake(void);
+void            swapstat(struct kmemstat*);
+
 // swtch.S
 void            swtch(struct context**, struct context*);
 
+// shm.c
+void            shminit(void);
+int             shmget(int, uint);
+struct shmseg*  shmattach(int, uint*);
+void            shmdup(struct shmseg*);
+void            shmput(struct shmseg*);
+int             shmrm(int);
+void            shmexit(int);
+char*           shmpage(struct shmseg*, uint);
+
+// slab.c
+void            slabinit(void);
+struct kmem_cache* kmem_cache_create(char*, uint, void (*)(void*));
+void*           kmem_cache_alloc(struct kmem_cache*);
+void            kmem_cache_free(struct kmem_cache*, void*);
+int             slabinfo(struct slabinfo*, int);
+
 // spinlock.c
 void            acquire(struct spinlock*);
 void            getcallerpcs(void*, uint*);
@@ -151,9 +211,9 @@ char*           strncpy(char*, const char*, int);
 // syscall.c
 int             argint(int, int*);
 int             argptr(int, char**, int);
-int             argstr(int, char**);
+int             argstr(int, char*, int);
 int             fetchint(uint, int*);
-int             fetchstr(uint, char**);
+int             fetchstr(uint, char*, int);
 void            syscall(void);
 
 // timer.c
@@ -165,6 +225,10 @@ extern uint     ticks;
 void            tvinit(void);
 extern struct spinlock tickslock;
 
+// uaccess.S
+int             copy_user(void*, const void*, uint);
+int             strlen_user(const char*, uint);
+
 // uart.c
 void            uartinit(void);
 void            uartintr(void);
@@ -177,14 +241,36 @@ pde_t*          setupkvm(void);
 char*           uva2ka(pde_t*, char*);
 int             allocuvm(pde_t*, uint, uint);
 int             deallocuvm(pde_t*, uint, uint);
+int             uvmrelease(pde_t*, uint, uint);
 void            freevm(pde_t*);
 void            inituvm(pde_t*, char*, uint);
 int             loaduvm(pde_t*, char*, struct inode*, uint, uint);
 pde_t*          copyuvm(pde_t*, uint);
 void            switchuvm(struct proc*);
 void            switchkvm(void);
+void            resumeuvm(struct proc*);
+void            idleuvm(void);
+void            reappgdirs(void);
 int             copyout(pde_t*, uint, void*, uint);
+int             copy_to_user(uint, void*, uint);
+int             copy_from_user(void*, uint, uint);
+int             uaccessfixup(struct trapframe*);
 void            clearpteu(pde_t *pgdir, char *uva);
+int             lazyfault(struct proc*, uint, int);
+int             uvmprefault(struct proc*, uint, uint);
+void            uvmcount(pde_t*, struct memstat*);
+char*           clockscan(pde_t*, uint, uint*, uint);
+
+// mmap.c
+int             mmap(uint, int, int, struct file*, uint);
+int             munmap(uint, uint);
+void            munmapall(struct proc*);
+int             mmapfork(struct proc*, struct proc*);
+int             mmapfault(struct proc*, uint, int);
+int             mmapprefault(struct proc*, uint, uint);
+uint            mmapbase(struct proc*);
+int             shmmap(struct shmseg*, uint);
+int             shmunmap(uint);
 
 // number of elements in fixed-size array
 #define NELEM(x) (sizeof(x)/sizeof((x)[0]))
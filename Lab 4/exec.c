@@ -11,11 +11,12 @@ int
 exec(char *path, char **argv)
 {
   char *s, *last;
-  int i, off;
+  int i, off, nseg;
   uint argc, sz, sp, ustack[3+MAXARG+1];
   struct elfhdr elf;
-  struct inode *ip;
+  struct inode *ip, *exe, *oldexe;
   struct proghdr ph;
+  struct seg seg[NSEG];
   pde_t *pgdir, *oldpgdir;
   struct proc *curproc = myproc();
 
@@ -28,6 +29,7 @@ exec(char *path, char **argv)
   }
   ilock(ip);
   pgdir = 0;
+  exe = 0;
 
   // Check ELF header
   if(readi(ip, (char*)&elf, 0, sizeof(elf)) != sizeof(elf))
@@ -38,8 +40,10 @@ exec(char *path, char **argv)
   if((pgdir = setupkvm()) == 0)
     goto bad;
 
-  // Load program into memory.
+  // Record the program's segments.  Nothing is read yet:
+  // lazyfault() loads each page from ip when it is first used.
   sz = 0;
+  nseg = 0;
   for(i=0, off=elf.phoff; i<elf.phnum; i++, off+=sizeof(ph)){
     if(readi(ip, (char*)&ph, off, sizeof(ph)) != sizeof(ph))
       goto bad;
@@ -49,15 +53,23 @@ exec(char *path, char **argv)
       goto bad;
     if(ph.vaddr + ph.memsz < ph.vaddr)
       goto bad;
-    if((sz = allocuvm(pgdir, sz, ph.vaddr + ph.memsz)) == 0)
+    if(ph.vaddr + ph.memsz >= KERNBASE)
       goto bad;
     if(ph.vaddr % PGSIZE != 0)
       goto bad;
-    if(loaduvm(pgdir, (char*)ph.vaddr, ip, ph.off, ph.filesz) < 0)
+    if(nseg == NSEG)
       goto bad;
+    seg[nseg].va = ph.vaddr;
+    seg[nseg].memsz = ph.memsz;
+    seg[nseg].off = ph.off;
+    seg[nseg].filesz = ph.filesz;
+    nseg++;
+    if(ph.vaddr + ph.memsz > sz)
+      sz = ph.vaddr + ph.memsz;
   }
-  iunlockput(ip);
+  iunlock(ip);
   end_op();
+  exe = ip;  // keep the reference for lazyfault()
   ip = 0;
 
   // Allocate two pages at the next page boundary.
@@ -94,13 +106,26 @@ exec(char *path, char **argv)
   safestrcpy(curproc->name, last, sizeof(curproc->name));
 
   // Commit to the user image.
+  munmapall(curproc);
   oldpgdir = curproc->pgdir;
+  oldexe = curproc->exe;
   curproc->pgdir = pgdir;
   curproc->sz = sz;
+  curproc->exe = exe;
+  curproc->nseg = nseg;
+  for(i = 0; i < nseg; i++)
+    curproc->seg[i] = seg[i];
+  curproc->lastfault = 0;
+  curproc->fawin = 1;
   curproc->tf->eip = elf.entry;  // main
   curproc->tf->esp = sp;
   switchuvm(curproc);
   freevm(oldpgdir);
+  if(oldexe){
+    begin_op();
+    iput(oldexe);
+    end_op();
+  }
   return 0;
 
  bad:
@@ -110,5 +135,10 @@ exec(char *path, char **argv)
     iunlockput(ip);
     end_op();
   }
+  if(exe){
+    begin_op();
+    iput(exe);
+    end_op();
+  }
   return -1;
 }
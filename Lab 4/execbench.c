@@ -0,0 +1,57 @@
+// Time how long a program takes to start up and exit.
+// The program runs n times with an empty stdin and with its
+// output thrown away, so interactive programs like sh exit at
+// once.  (usertests exits straight away once usertests.ran
+// exists, which makes it a good test of a large binary.)
+//
+// usage: execbench n prog [args...]
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+
+int
+main(int argc, char *argv[])
+{
+  int i, n, t, in[2], out[2];
+
+  if(argc < 3 || (n = atoi(argv[1])) <= 0){
+    printf(2, "usage: execbench n prog [args...]\n");
+    exit();
+  }
+
+  t = uptime();
+  for(i = 0; i < n; i++){
+    if(pipe(in) < 0 || pipe(out) < 0){
+      printf(2, "execbench: pipe failed\n");
+      exit();
+    }
+    switch(fork()){
+    case -1:
+      printf(2, "execbench: fork failed\n");
+      exit();
+    case 0:
+      // stdin reads EOF; writes to stdout and stderr fail.
+      close(0);
+      dup(in[0]);
+      close(1);
+      dup(out[1]);
+      close(2);
+      dup(out[1]);
+      close(in[0]);
+      close(in[1]);
+      close(out[0]);
+      close(out[1]);
+      exec(argv[2], argv + 2);
+      exit();
+    }
+    close(in[0]);
+    close(in[1]);
+    close(out[0]);
+    close(out[1]);
+    wait();
+  }
+  t = uptime() - t;
+  printf(1, "%s: %d runs in %d ticks\n", argv[2], n, t);
+  exit();
+}
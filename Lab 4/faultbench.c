@@ -0,0 +1,66 @@
+// Touch a freshly sbrk'd region one page at a time, first with
+// fault-around disabled and then with the default window, and
+// report the ticks and page-fault traps each pass took, and how
+// many of the pages came already zeroed from kzerod's pool.
+//
+// usage: faultbench [pages]
+
+#include "types.h"
+#include "stat.h"
+#include "param.h"
+#include "memstat.h"
+#include "kmemstat.h"
+#include "user.h"
+
+#define PGSIZE 4096
+
+static void
+run(char *label, int npages, int window)
+{
+  struct memstat before, after;
+  struct kmemstat kbefore, kafter;
+  char *p;
+  int i, old, t;
+
+  old = faultaround(window);
+  memstat(0, &before);
+  kmemstat(&kbefore);
+  t = uptime();
+  if((p = sbrk(npages * PGSIZE)) == (char*)-1){
+    printf(2, "faultbench: sbrk failed\n");
+    exit();
+  }
+  for(i = 0; i < npages; i++)
+    p[i * PGSIZE] = i;
+  t = uptime() - t;
+  memstat(0, &after);
+  kmemstat(&kafter);
+  faultaround(old);
+
+  printf(1, "%s: %d pages, %d ticks, %d faults, %d prefaulted, "
+         "%d pre-zeroed\n", label, npages, t,
+         after.nfault - before.nfault, after.nprefault - before.nprefault,
+         kafter.zhits - kbefore.zhits);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int npages, window;
+
+  npages = 1024;
+  if(argc > 1)
+    npages = atoi(argv[1]);
+  if(npages <= 0){
+    printf(2, "usage: faultbench [pages]\n");
+    exit();
+  }
+
+  // Read the current window size without changing it.
+  window = faultaround(1);
+  faultaround(window);
+
+  run("one page per fault", npages, 1);
+  run("fault-around", npages, window);
+  exit();
+}
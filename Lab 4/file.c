@@ -12,14 +12,16 @@
 
 struct devsw devsw[NDEV];
 struct {
-  struct spinlock lock;
-  struct file file[NFILE];
+  struct spinlock lock;  // protects ref of every open file
+  struct kmem_cache *cache;
+  int nfile;
 } ftable;
 
 void
 fileinit(void)
 {
   initlock(&ftable.lock, "ftable");
+  ftable.cache = kmem_cache_create("file", sizeof(struct file), 0);
 }
 
 // Allocate a file structure.
@@ -29,15 +31,22 @@ filealloc(void)
   struct file *f;
 
   acquire(&ftable.lock);
-  for(f = ftable.file; f < ftable.file + NFILE; f++){
-    if(f->ref == 0){
-      f->ref = 1;
-      release(&ftable.lock);
-      return f;
-    }
+  if(ftable.nfile >= NFILE){
+    release(&ftable.lock);
+    return 0;
   }
+  ftable.nfile++;
   release(&ftable.lock);
-  return 0;
+
+  if((f = kmem_cache_alloc(ftable.cache)) == 0){
+    acquire(&ftable.lock);
+    ftable.nfile--;
+    release(&ftable.lock);
+    return 0;
+  }
+  memset(f, 0, sizeof(*f));
+  f->ref = 1;
+  return f;
 }
 
 // Increment ref count for file f.
@@ -68,7 +77,9 @@ fileclose(struct file *f)
   ff = *f;
   f->ref = 0;
   f->type = FD_NONE;
+  ftable.nfile--;
   release(&ftable.lock);
+  kmem_cache_free(ftable.cache, f);
 
   if(ff.type == FD_PIPE)
     pipeclose(ff.pipe, ff.writable);
@@ -125,12 +136,14 @@ filewrite(struct file *f, char *addr, int n)
     return pipewrite(f->pipe, addr, n);
   if(f->type == FD_INODE){
     // write a few blocks at a time to avoid exceeding
-    // the maximum log transaction size, including
-    // i-node, indirect block, allocation blocks,
-    // and 2 blocks of slop for non-aligned writes.
+    // the maximum transaction size.  file data is not
+    // logged, so only the i-node, indirect blocks and
+    // allocation blocks count against the log; keep the
+    // data, plus a block of slop for non-aligned writes,
+    // within the MAXOPDATA blocks a transaction can send home.
     // this really belongs lower down, since writei()
     // might be writing a device like the console.
-    int max = ((MAXOPBLOCKS-1-1-2) / 2) * 512;
+    int max = (MAXOPDATA-1) * 512;
     int i = 0;
     while(i < n){
       int n1 = n - i;
@@ -146,9 +159,9 @@ filewrite(struct file *f, char *addr, int n)
 
       if(r < 0)
         break;
-      if(r != n1)
-        panic("short filewrite");
       i += r;
+      if(r != n1)
+        break;   // the file cannot grow any further
     }
     return i == n ? n : -1;
   }
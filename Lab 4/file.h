@@ -14,15 +14,24 @@ struct inode {
   uint dev;           // Device number
   uint inum;          // Inode number
   int ref;            // Reference count
+  struct inode *hnext;  // icache hash chain
+  struct inode *prev;   // LRU list
+  struct inode *next;
   struct sleeplock lock; // protects everything below here
   int valid;          // inode has been read from disk?
+  uint ranext;        // block after the last one readi() read
+  uint rawin;         // readahead window, in blocks
+  uint raend;         // blocks before this have been read ahead
+  uint xbn;           // the last extent bmap() used maps xlen
+  uint xstart;        //   blocks from file block xbn to xstart
+  uint xlen;
 
   short type;         // copy of disk inode
   short major;
   short minor;
   short nlink;
   uint size;
-  uint addrs[NDIRECT+1];
+  uint addrs[NDIRECT+2];
 };
 
 // table mapping major device number to
@@ -20,9 +20,12 @@
 #include "fs.h"
 #include "buf.h"
 #include "file.h"
+#include "fsstat.h"
 
 #define min(a, b) ((a) < (b) ? (a) : (b))
 static void itrunc(struct inode*);
+static uint xmap(struct inode*, uint);
+static void xtrunc(struct inode*);
 // there should be one superblock per disk device, but we run with
 // only one device
 struct superblock sb; 
@@ -44,57 +47,204 @@ bzero(int dev, int bno)
 {
   struct buf *bp;
 
-  bp = bread(dev, bno);
-  memset(bp->data, 0, BSIZE);
+  bp = bclear(dev, bno);
   log_write(bp);
   brelse(bp);
 }
 
 // Blocks.
+//
+// The free block bitmap is kept in memory as well as on disk, with
+// a count of the free blocks in each group of BGROUP, so balloc()
+// can skip full groups and scan a word at a time.  Allocations
+// without a goal start at a cursor that moves on round the disk.
+// A block freed by a transaction stays in use in memory until the
+// transaction commits and the log calls bfreed(): until then the
+// old owner still has it on disk.  The on-disk bitmap is updated
+// through the log as before.
 
-// Allocate a zeroed disk block.
-static uint
-balloc(uint dev)
+#define BGROUP 256  // blocks per free count
+
+struct {
+  struct spinlock lock;
+  uint cursor;                       // where goal-less searches start
+  uint nfree;                        // free blocks
+  uint map[FSSIZE/32 + 1];           // a bit per block, set if in use
+  ushort gfree[FSSIZE/BGROUP + 1];   // free blocks in each group
+} fmap;
+
+// Read the free block bitmap into memory.  Called once the log
+// has been recovered.
+void
+ballocinit(int dev)
 {
-  int b, bi, m;
   struct buf *bp;
+  uint b, bi;
 
-  bp = 0;
+  if(sb.size > FSSIZE)
+    panic("ballocinit: file system too big");
+  initlock(&fmap.lock, "fmap");
+  memset(fmap.map, 0xff, sizeof(fmap.map));
   for(b = 0; b < sb.size; b += BPB){
     bp = bread(dev, BBLOCK(b, sb));
     for(bi = 0; bi < BPB && b + bi < sb.size; bi++){
-      m = 1 << (bi % 8);
-      if((bp->data[bi/8] & m) == 0){  // Is block free?
-        bp->data[bi/8] |= m;  // Mark block in use.
-        log_write(bp);
-        brelse(bp);
-        bzero(dev, b + bi);
-        return b + bi;
+      if((bp->data[bi/8] & (1 << (bi % 8))) == 0){
+        fmap.map[(b + bi)/32] &= ~(1 << ((b + bi) % 32));
+        fmap.gfree[(b + bi)/BGROUP]++;
+        fmap.nfree++;
       }
     }
     brelse(bp);
   }
-  panic("balloc: out of blocks");
+  fmap.cursor = sb.size - sb.nblocks;
+}
+
+static int
+fisfree(uint b)
+{
+  return b < sb.size && (fmap.map[b/32] & (1 << (b % 32))) == 0;
 }
 
-// Free a disk block.
 static void
-bfree(int dev, uint b)
+fuse(uint b)
+{
+  fmap.map[b/32] |= 1 << (b % 32);
+  fmap.gfree[b/BGROUP]--;
+  fmap.nfree--;
+}
+
+// Find the first free block at or after goal, wrapping around,
+// that starts a run of run free blocks.  Returns 0 if there is
+// none.  Caller holds fmap.lock.
+static uint
+ffind(uint goal, uint run)
+{
+  uint b, end, bits, j;
+
+  // Search [goal, sb.size), then [0, goal).
+  b = goal;
+  end = sb.size;
+  for(;;){
+    if(b >= end){
+      if(end == goal)
+        return 0;
+      b = 0;
+      end = goal;
+      continue;
+    }
+    if(fmap.gfree[b/BGROUP] == 0){
+      b += BGROUP - b % BGROUP;
+      continue;
+    }
+    bits = ~fmap.map[b/32] & (~0U << (b % 32));
+    if(bits == 0){
+      b += 32 - b % 32;
+      continue;
+    }
+    b += __builtin_ctz(bits) - b % 32;
+    if(b >= end)
+      continue;
+    for(j = 1; j < run && fisfree(b + j); j++)
+      ;
+    if(j == run)
+      return b;
+    b += j;
+  }
+}
+
+// Set or clear block b's bit in the on-disk bitmap, through the log.
+static void
+bmark(uint dev, uint b, int used)
 {
   struct buf *bp;
-  int bi, m;
+  uint bi;
+  int m;
 
-  readsb(dev, &sb);
   bp = bread(dev, BBLOCK(b, sb));
   bi = b % BPB;
   m = 1 << (bi % 8);
-  if((bp->data[bi/8] & m) == 0)
+  if(!used && (bp->data[bi/8] & m) == 0)
     panic("freeing free block");
-  bp->data[bi/8] &= ~m;
+  if(used)
+    bp->data[bi/8] |= m;
+  else
+    bp->data[bi/8] &= ~m;
   log_write(bp);
   brelse(bp);
 }
 
+// Allocate a disk block, near goal (or at the cursor if goal is 0)
+// and at the start of a run of run free blocks if there is one.
+// Its contents are whatever was there before; the caller zeroes it
+// or writes it in full.
+static uint
+balloc(uint dev, uint goal, uint run)
+{
+  uint b;
+
+  acquire(&fmap.lock);
+  if(goal == 0 || goal >= sb.size)
+    goal = fmap.cursor;
+  b = 0;
+  if(run > 1)
+    b = ffind(goal, run);
+  if(b == 0 && (b = ffind(goal, 1)) == 0)
+    panic("balloc: out of blocks");
+  fuse(b);
+  if(goal == fmap.cursor)
+    fmap.cursor = b + 1 < sb.size ? b + 1 : 0;
+  release(&fmap.lock);
+  bmark(dev, b, 1);
+  return b;
+}
+
+// Allocate block b if it is free.  Returns 0 if it is not.
+static int
+ballocat(uint dev, uint b)
+{
+  acquire(&fmap.lock);
+  if(!fisfree(b)){
+    release(&fmap.lock);
+    return 0;
+  }
+  fuse(b);
+  release(&fmap.lock);
+  bmark(dev, b, 1);
+  return 1;
+}
+
+// Free a disk block.  It stays in use in memory until the log
+// calls bfreed().
+static void
+bfree(int dev, uint b)
+{
+  bmark(dev, b, 0);
+  log_free(b);
+}
+
+// The transaction that freed block b has committed: b may be
+// allocated again.
+void
+bfreed(uint b)
+{
+  acquire(&fmap.lock);
+  if(fisfree(b) || b >= sb.size)
+    panic("bfreed");
+  fmap.map[b/32] &= ~(1 << (b % 32));
+  fmap.gfree[b/BGROUP]++;
+  fmap.nfree++;
+  release(&fmap.lock);
+}
+
+// Fill in the free block count.
+void
+bfreestat(struct fsstat *st)
+{
+  acquire(&fmap.lock);
+  st->nfreeblock = fmap.nfree;
+  release(&fmap.lock);
+}
+
 // Inodes.
 //
 // An inode describes a single unnamed file.
@@ -106,9 +256,10 @@ bfree(int dev, uint b)
 // sb.startinode. Each inode has a number, indicating its
 // position on the disk.
 //
-// The kernel keeps a cache of in-use inodes in memory
+// The kernel keeps a cache of inodes in memory
 // to provide a place for synchronizing access
-// to inodes used by multiple processes. The cached
+// to inodes used by multiple processes, and to save
+// reading inodes that were used recently. The cached
 // inodes include book-keeping information that is
 // not stored on disk: ip->ref and ip->valid.
 //
@@ -120,18 +271,20 @@ bfree(int dev, uint b)
 //   is non-zero. ialloc() allocates, and iput() frees if
 //   the reference and link counts have fallen to zero.
 //
-// * Referencing in cache: an entry in the inode cache
-//   is free if ip->ref is zero. Otherwise ip->ref tracks
-//   the number of in-memory pointers to the entry (open
-//   files and current directories). iget() finds or
-//   creates a cache entry and increments its ref; iput()
-//   decrements ref.
+// * Referencing in cache: ip->ref tracks the number of
+//   in-memory pointers to the entry (open files and
+//   current directories). iget() finds or creates a
+//   cache entry and increments its ref; iput() decrements
+//   ref. An entry whose ref is zero stays cached, and
+//   iget() finds it again, until it is recycled for
+//   another inode.
 //
 // * Valid: the information (type, size, &c) in an inode
 //   cache entry is only correct when ip->valid is 1.
-//   ilock() reads the inode from
-//   the disk and sets ip->valid, while iput() clears
-//   ip->valid if ip->ref has fallen to zero.
+//   ilock() reads the inode from the disk and sets
+//   ip->valid, while iput() clears ip->valid when it
+//   frees the inode, and iget() when it recycles the
+//   entry.
 //
 // * Locked: file system code may only examine and modify
 //   the information in an inode and its content if it
@@ -155,39 +308,150 @@ bfree(int dev, uint b)
 // have locked the inodes involved; this lets callers create
 // multi-step atomic operations.
 //
-// The icache.lock spin-lock protects the allocation of icache
-// entries. Since ip->ref indicates whether an entry is free,
-// and ip->dev and ip->inum indicate which i-node an entry
-// holds, one must hold icache.lock while using any of those fields.
+// Entries are found through a hash table keyed by (dev, inum),
+// as in the buffer cache.  Each bucket's lock protects its chain
+// and the ref of the entries on it, so a lookup that hits takes
+// no global lock.  Every entry is also on an LRU list, under
+// icache.lock, used to pick an unreferenced entry to recycle; one
+// must hold icache.lock and the bucket lock to change which i-node
+// an entry holds (ip->dev and ip->inum).  Lock order: icache.lock,
+// then bucket locks.
+//
+// Entries are allocated from a slab cache.  iinit() allows the
+// cache 1/INODEMEM of the memory free at boot, at least NINODE
+// entries and at most NINODEMAX or the number of inodes on disk.
 //
 // An ip->lock sleep-lock protects all ip-> fields other than ref,
 // dev, and inum.  One must hold ip->lock in order to
 // read or write that inode's ip->valid, ip->size, ip->type, &c.
 
+struct ibucket {
+  struct spinlock lock;
+  struct inode *head;   // chain through hnext
+  uint nhit;            // lookups that found their inode here
+};
+
 struct {
   struct spinlock lock;
-  struct inode inode[NINODE];
+  struct kmem_cache *cache;
+  uint ninode;          // entries allocated
+  uint maxinode;        // ... and the most there may be
+  uint nmiss;
+
+  // Linked list of all entries, through prev/next.
+  // head.next is most recently used.
+  struct inode head;
+
+  struct ibucket hash[NINODEHASH];
 } icache;
 
+static struct ibucket*
+ibucket(uint dev, uint inum)
+{
+  return &icache.hash[(dev * 31 + inum) % NINODEHASH];
+}
+
+static void
+inodector(void *p)
+{
+  initsleeplock(&((struct inode*)p)->lock, "inode");
+}
+
+// Allocate a cache entry and put it at the LRU end of the list,
+// hashed as inode 0 of dev 0.  Caller holds icache.lock.
+static struct inode*
+inew(void)
+{
+  struct inode *ip;
+  struct ibucket *h;
+
+  if((ip = kmem_cache_alloc(icache.cache)) == 0)
+    return 0;
+  ip->dev = 0;
+  ip->inum = 0;
+  ip->ref = 0;
+  ip->valid = 0;
+  h = ibucket(0, 0);
+  acquire(&h->lock);
+  ip->hnext = h->head;
+  h->head = ip;
+  release(&h->lock);
+  ip->next = &icache.head;
+  ip->prev = icache.head.prev;
+  icache.head.prev->next = ip;
+  icache.head.prev = ip;
+  icache.ninode++;
+  return ip;
+}
+
 void
 iinit(int dev)
 {
-  int i = 0;
-  
-  initlock(&icache.lock, "icache");
-  for(i = 0; i < NINODE; i++) {
-    initsleeplock(&icache.inode[i].lock, "inode");
-  }
+  struct ibucket *h;
+  uint n;
 
   readsb(dev, &sb);
   cprintf("sb: size %d nblocks %d ninodes %d nlog %d logstart %d\
  inodestart %d bmap start %d\n", sb.size, sb.nblocks,
           sb.ninodes, sb.nlog, sb.logstart, sb.inodestart,
           sb.bmapstart);
+
+  initlock(&icache.lock, "icache");
+  for(h = icache.hash; h < &icache.hash[NINODEHASH]; h++)
+    initlock(&h->lock, "icache.bucket");
+  icache.cache = kmem_cache_create("inode", sizeof(struct inode),
+                                   inodector);
+  n = kfreepages() / INODEMEM * (PGSIZE / sizeof(struct inode));
+  if(n > NINODEMAX)
+    n = NINODEMAX;
+  if(n > sb.ninodes)
+    n = sb.ninodes;
+  if(n < NINODE)
+    n = NINODE;
+  icache.maxinode = n;
+
+  // The first NINODE entries come now, so that there are always
+  // that many to go round.
+  icache.head.prev = &icache.head;
+  icache.head.next = &icache.head;
+  acquire(&icache.lock);
+  while(icache.ninode < NINODE)
+    if(inew() == 0)
+      panic("iinit");
+  release(&icache.lock);
 }
 
 static struct inode* iget(uint dev, uint inum);
 
+// Look for inode inum of dev in h, whose lock is held, and take
+// a reference to it if it is there.
+static struct inode*
+ifind(struct ibucket *h, uint dev, uint inum)
+{
+  struct inode *ip;
+
+  for(ip = h->head; ip; ip = ip->hnext){
+    if(ip->dev == dev && ip->inum == inum){
+      ip->ref++;
+      h->nhit++;
+      return ip;
+    }
+  }
+  return 0;
+}
+
+// Take ip off h's chain, whose lock is held.
+static void
+iunhash(struct ibucket *h, struct inode *ip)
+{
+  struct inode **pp;
+
+  for(pp = &h->head; *pp != ip; pp = &(*pp)->hnext)
+    if(*pp == 0)
+      panic("iunhash");
+  *pp = ip->hnext;
+}
+
 //PAGEBREAK!
 // Allocate an inode on device dev.
 // Mark it as allocated by  giving it type type.
@@ -242,34 +506,58 @@ iupdate(struct inode *ip)
 static struct inode*
 iget(uint dev, uint inum)
 {
-  struct inode *ip, *empty;
+  struct inode *ip;
+  struct ibucket *h, *g;
 
-  acquire(&icache.lock);
+  h = ibucket(dev, inum);
+  acquire(&h->lock);
+  ip = ifind(h, dev, inum);
+  release(&h->lock);
+  if(ip)
+    return ip;
 
-  // Is the inode already cached?
-  empty = 0;
-  for(ip = &icache.inode[0]; ip < &icache.inode[NINODE]; ip++){
-    if(ip->ref > 0 && ip->dev == dev && ip->inum == inum){
-      ip->ref++;
+  // Not cached.  Check again with icache.lock held, since only a
+  // process holding it can add the inode to the cache.
+  acquire(&icache.lock);
+  acquire(&h->lock);
+  ip = ifind(h, dev, inum);
+  release(&h->lock);
+  if(ip){
+    release(&icache.lock);
+    return ip;
+  }
+  icache.nmiss++;
+
+  // Add an entry if there is room; otherwise recycle the least
+  // recently used unreferenced one.
+  if(icache.ninode < icache.maxinode && kfreepages() > SWAPHIGH)
+    inew();
+  for(ip = icache.head.prev; ip != &icache.head; ip = ip->prev){
+    if(ip->ref != 0)
+      continue;   // unlocked peek; checked again below
+    g = ibucket(ip->dev, ip->inum);
+    acquire(&g->lock);
+    if(ip->ref == 0){
+      iunhash(g, ip);
+      ip->dev = dev;
+      ip->inum = inum;
+      ip->ref = 1;
+      ip->valid = 0;
+      ip->ranext = 0;
+      ip->rawin = 0;
+      ip->raend = 0;
+      ip->xlen = 0;
+      release(&g->lock);
+      acquire(&h->lock);
+      ip->hnext = h->head;
+      h->head = ip;
+      release(&h->lock);
       release(&icache.lock);
       return ip;
     }
-    if(empty == 0 && ip->ref == 0)    // Remember empty slot.
-      empty = ip;
+    release(&g->lock);
   }
-
-  // Recycle an inode cache entry.
-  if(empty == 0)
-    panic("iget: no inodes");
-
-  ip = empty;
-  ip->dev = dev;
-  ip->inum = inum;
-  ip->ref = 1;
-  ip->valid = 0;
-  release(&icache.lock);
-
-  return ip;
+  panic("iget: no inodes");
 }
 
 // Increment reference count for ip.
@@ -277,9 +565,12 @@ iget(uint dev, uint inum)
 struct inode*
 idup(struct inode *ip)
 {
-  acquire(&icache.lock);
+  struct ibucket *h;
+
+  h = ibucket(ip->dev, ip->inum);
+  acquire(&h->lock);
   ip->ref++;
-  release(&icache.lock);
+  release(&h->lock);
   return ip;
 }
 
@@ -332,11 +623,14 @@ iunlock(struct inode *ip)
 void
 iput(struct inode *ip)
 {
+  struct ibucket *h;
+
+  h = ibucket(ip->dev, ip->inum);
   acquiresleep(&ip->lock);
   if(ip->valid && ip->nlink == 0){
-    acquire(&icache.lock);
+    acquire(&h->lock);
     int r = ip->ref;
-    release(&icache.lock);
+    release(&h->lock);
     if(r == 1){
       // inode has no links and no other references: truncate and free.
       itrunc(ip);
@@ -347,11 +641,50 @@ iput(struct inode *ip)
   }
   releasesleep(&ip->lock);
 
+  acquire(&h->lock);
+  if(ip->ref > 1){
+    ip->ref--;
+    release(&h->lock);
+    return;
+  }
+  release(&h->lock);
+
+  // Probably the last reference.  Moving ip on the LRU list needs
+  // icache.lock, which comes first; our reference keeps ip from
+  // being recycled meanwhile.
   acquire(&icache.lock);
-  ip->ref--;
+  acquire(&h->lock);
+  if(--ip->ref == 0){
+    ip->next->prev = ip->prev;
+    ip->prev->next = ip->next;
+    ip->next = icache.head.next;
+    ip->prev = &icache.head;
+    icache.head.next->prev = ip;
+    icache.head.next = ip;
+  }
+  release(&h->lock);
   release(&icache.lock);
 }
 
+// Fill in the inode cache statistics.
+void
+istat(struct fsstat *st)
+{
+  struct ibucket *h;
+
+  acquire(&icache.lock);
+  st->ninode = icache.ninode;
+  st->maxinode = icache.maxinode;
+  st->nimiss = icache.nmiss;
+  release(&icache.lock);
+  st->nihit = 0;
+  for(h = icache.hash; h < &icache.hash[NINODEHASH]; h++){
+    acquire(&h->lock);
+    st->nihit += h->nhit;
+    release(&h->lock);
+  }
+}
+
 // Common idiom: unlock, then put.
 void
 iunlockput(struct inode *ip)
@@ -366,40 +699,261 @@ iunlockput(struct inode *ip)
 // The content (data) associated with each inode is stored
 // in blocks on the disk. The first NDIRECT block numbers
 // are listed in ip->addrs[].  The next NINDIRECT blocks are
-// listed in block ip->addrs[NDIRECT].
+// listed in block ip->addrs[NDIRECT].  The NDINDIRECT blocks
+// after those are listed in the indirect blocks that the
+// double-indirect block ip->addrs[NDIRECT+1] lists.
+
+// Return entry i of indirect block addr, allocating a block for
+// it if necessary.  A new block that will hold block numbers
+// (ind is set) is zeroed; a new data block is left to writei().
+static uint
+bmapind(struct inode *ip, uint addr, uint i, int ind)
+{
+  uint *a;
+  struct buf *bp;
+
+  bp = bread(ip->dev, addr);
+  a = (uint*)bp->data;
+  if((addr = a[i]) == 0){
+    a[i] = addr = balloc(ip->dev, 0, 1);
+    if(ind)
+      bzero(ip->dev, addr);
+    log_write(bp);
+  }
+  brelse(bp);
+  return addr;
+}
 
 // Return the disk block address of the nth block in inode ip.
-// If there is no such block, bmap allocates one.
+// If there is no such block, bmap allocates one, without
+// zeroing it: only writei() allocates, and it fills the block.
+// Returns 0 if the file can have no more blocks.
 static uint
 bmap(struct inode *ip, uint bn)
 {
-  uint addr, *a;
-  struct buf *bp;
+  uint addr;
+
+  if(sb.flags & FS_EXTENTS)
+    return xmap(ip, bn);
 
   if(bn < NDIRECT){
     if((addr = ip->addrs[bn]) == 0)
-      ip->addrs[bn] = addr = balloc(ip->dev);
+      ip->addrs[bn] = addr = balloc(ip->dev, 0, 1);
     return addr;
   }
   bn -= NDIRECT;
 
   if(bn < NINDIRECT){
     // Load indirect block, allocating if necessary.
-    if((addr = ip->addrs[NDIRECT]) == 0)
-      ip->addrs[NDIRECT] = addr = balloc(ip->dev);
-    bp = bread(ip->dev, addr);
-    a = (uint*)bp->data;
-    if((addr = a[bn]) == 0){
-      a[bn] = addr = balloc(ip->dev);
-      log_write(bp);
+    if((addr = ip->addrs[NDIRECT]) == 0){
+      ip->addrs[NDIRECT] = addr = balloc(ip->dev, 0, 1);
+      bzero(ip->dev, addr);
     }
-    brelse(bp);
-    return addr;
+    return bmapind(ip, addr, bn, 0);
+  }
+  bn -= NINDIRECT;
+
+  if(bn < NDINDIRECT){
+    // Load the double-indirect block, then the indirect block
+    // it lists, allocating either if necessary.
+    if((addr = ip->addrs[NDIRECT+1]) == 0){
+      ip->addrs[NDIRECT+1] = addr = balloc(ip->dev, 0, 1);
+      bzero(ip->dev, addr);
+    }
+    addr = bmapind(ip, addr, bn / NINDIRECT, 1);
+    return bmapind(ip, addr, bn % NINDIRECT, 0);
   }
 
   panic("bmap: out of range");
 }
 
+// Free the blocks that indirect block addr lists, and then addr
+// itself.  If depth is 2, they are indirect blocks in turn.
+static void
+itruncind(struct inode *ip, uint addr, int depth)
+{
+  struct buf *bp;
+  uint *a;
+  int j;
+
+  bp = bread(ip->dev, addr);
+  a = (uint*)bp->data;
+  for(j = 0; j < NINDIRECT; j++){
+    if(a[j] == 0)
+      continue;
+    if(depth > 1)
+      itruncind(ip, a[j], depth - 1);
+    else
+      bfree(ip->dev, a[j]);
+  }
+  brelse(bp);
+  bfree(ip->dev, addr);
+}
+
+// Extents.
+
+#define XRUN     8   // free blocks a new extent looks for
+#define XSKIP   64   // ... this far past a run another file cut off
+#define XGROUPS 16   // parts of the disk first extents spread over
+
+// Note that file blocks from base on map to extent x, for the
+// next xmap(), and return the disk block that maps bn.
+static uint
+xhit(struct inode *ip, uint base, struct extent *x, uint bn)
+{
+  ip->xbn = base;
+  ip->xstart = x->start;
+  ip->xlen = x->len;
+  return x->start + (bn - base);
+}
+
+// File block bn is just past the end of the file, and the last
+// extents of the file are the first i of the n in x.  Map bn by
+// growing the last one if the disk block after it is free, or by
+// starting a new extent, near goal if it is the first in x.  If
+// some other file took the next block, it is probably growing
+// too: the new extent starts a little way on, to leave it room.
+// Returns the disk block, or 0 if x is full.
+static uint
+xgrow(struct inode *ip, struct extent *x, int i, int n, uint bn, uint goal)
+{
+  if(i > 0){
+    goal = x[i-1].start + x[i-1].len;
+    if(ballocat(ip->dev, goal)){
+      x[i-1].len++;
+      return xhit(ip, bn + 1 - x[i-1].len, &x[i-1], bn);
+    }
+    goal += XSKIP;
+  }
+  if(i == n)
+    return 0;
+  x[i].start = balloc(ip->dev, goal, XRUN);
+  x[i].len = 1;
+  return xhit(ip, bn, &x[i], bn);
+}
+
+// bmap() for a file system with FS_EXTENTS.  Only a block just
+// past the end of the file can be missing.  Returns 0 if it is
+// missing and every extent slot is taken: a file on a badly
+// fragmented disk can run out of them well short of MAXFILE.
+static uint
+xmap(struct inode *ip, uint bn)
+{
+  struct extent *x;
+  struct xindex *xi;
+  struct buf *ib, *lb;
+  uint base, addr, goal;
+  int i, j;
+
+  if(bn >= ip->xbn && bn < ip->xbn + ip->xlen)
+    return ip->xstart + (bn - ip->xbn);
+
+  // The extents in the inode.  A file's first extent starts in
+  // a part of the disk chosen by its inode number, so that files
+  // written at the same time do not take turns at the blocks.
+  x = (struct extent*)ip->addrs;
+  base = 0;
+  for(i = 0; i < NIEXTENT && x[i].len > 0; i++){
+    if(bn < base + x[i].len)
+      return xhit(ip, base, &x[i], bn);
+    base += x[i].len;
+  }
+  goal = sb.size - sb.nblocks + ip->inum % XGROUPS * (sb.nblocks / XGROUPS);
+  if(ip->addrs[XINDEX] == 0){
+    if(bn != base)
+      panic("xmap: hole");
+    if((addr = xgrow(ip, x, i, NIEXTENT, bn, goal)) != 0)
+      return addr;
+    // The inode is full: start the index.
+    ip->addrs[XINDEX] = balloc(ip->dev, 0, 1);
+    bzero(ip->dev, ip->addrs[XINDEX]);
+  }
+  goal = x[NIEXTENT-1].start + x[NIEXTENT-1].len;
+
+  // The leaf that maps bn is the last one starting at or before it.
+  ib = bread(ip->dev, ip->addrs[XINDEX]);
+  xi = (struct xindex*)ib->data;
+  for(j = 0; j + 1 < NXINDEX && xi[j+1].leaf && xi[j+1].bn <= bn; j++)
+    ;
+  if(xi[j].leaf == 0){
+    xi[j].bn = base;
+    xi[j].leaf = balloc(ip->dev, 0, 1);
+    bzero(ip->dev, xi[j].leaf);
+    log_write(ib);
+  }
+  lb = bread(ip->dev, xi[j].leaf);
+  x = (struct extent*)lb->data;
+  base = xi[j].bn;
+  for(i = 0; i < NXLEAF && x[i].len > 0; i++){
+    if(bn < base + x[i].len){
+      addr = xhit(ip, base, &x[i], bn);
+      brelse(lb);
+      brelse(ib);
+      return addr;
+    }
+    base += x[i].len;
+  }
+  if(bn != base)
+    panic("xmap: hole");
+  if((addr = xgrow(ip, x, i, NXLEAF, bn, goal)) == 0){
+    // The leaf is full: start another.
+    if(++j == NXINDEX){
+      brelse(lb);
+      brelse(ib);
+      return 0;
+    }
+    goal = x[NXLEAF-1].start + x[NXLEAF-1].len;
+    brelse(lb);
+    xi[j].bn = bn;
+    xi[j].leaf = balloc(ip->dev, 0, 1);
+    bzero(ip->dev, xi[j].leaf);
+    log_write(ib);
+    lb = bread(ip->dev, xi[j].leaf);
+    addr = xgrow(ip, (struct extent*)lb->data, 0, NXLEAF, bn, goal);
+  }
+  log_write(lb);
+  brelse(lb);
+  brelse(ib);
+  return addr;
+}
+
+// Free the blocks of the extents in x, which has room for n.
+static void
+xfree(struct inode *ip, struct extent *x, int n)
+{
+  uint b;
+  int i;
+
+  for(i = 0; i < n && x[i].len > 0; i++)
+    for(b = x[i].start; b < x[i].start + x[i].len; b++)
+      bfree(ip->dev, b);
+}
+
+// itrunc() for a file system with FS_EXTENTS.
+static void
+xtrunc(struct inode *ip)
+{
+  struct xindex *xi;
+  struct buf *ib, *lb;
+  int j;
+
+  xfree(ip, (struct extent*)ip->addrs, NIEXTENT);
+  if(ip->addrs[XINDEX]){
+    ib = bread(ip->dev, ip->addrs[XINDEX]);
+    xi = (struct xindex*)ib->data;
+    for(j = 0; j < NXINDEX && xi[j].leaf; j++){
+      lb = bread(ip->dev, xi[j].leaf);
+      xfree(ip, (struct extent*)lb->data, NXLEAF);
+      brelse(lb);
+      bfree(ip->dev, xi[j].leaf);
+    }
+    brelse(ib);
+    bfree(ip->dev, ip->addrs[XINDEX]);
+  }
+  memset(ip->addrs, 0, sizeof(ip->addrs));
+  ip->xlen = 0;
+}
+
 // Truncate inode (discard contents).
 // Only called when the inode has no links
 // to it (no directory entries referring to it)
@@ -408,9 +962,14 @@ bmap(struct inode *ip, uint bn)
 static void
 itrunc(struct inode *ip)
 {
-  int i, j;
-  struct buf *bp;
-  uint *a;
+  int i;
+
+  if(sb.flags & FS_EXTENTS){
+    xtrunc(ip);
+    ip->size = 0;
+    iupdate(ip);
+    return;
+  }
 
   for(i = 0; i < NDIRECT; i++){
     if(ip->addrs[i]){
@@ -420,17 +979,15 @@ itrunc(struct inode *ip)
   }
 
   if(ip->addrs[NDIRECT]){
-    bp = bread(ip->dev, ip->addrs[NDIRECT]);
-    a = (uint*)bp->data;
-    for(j = 0; j < NINDIRECT; j++){
-      if(a[j])
-        bfree(ip->dev, a[j]);
-    }
-    brelse(bp);
-    bfree(ip->dev, ip->addrs[NDIRECT]);
+    itruncind(ip, ip->addrs[NDIRECT], 1);
     ip->addrs[NDIRECT] = 0;
   }
 
+  if(ip->addrs[NDIRECT+1]){
+    itruncind(ip, ip->addrs[NDIRECT+1], 2);
+    ip->addrs[NDIRECT+1] = 0;
+  }
+
   ip->size = 0;
   iupdate(ip);
 }
@@ -447,13 +1004,47 @@ stati(struct inode *ip, struct stat *st)
   st->size = ip->size;
 }
 
+// Called by readi() once it has read [off, off+n) of ip.  If the
+// read carried on where the last one left off, start reading the
+// blocks after it from disk, without waiting, so that they are in
+// the cache by the time they are asked for.  The window doubles
+// on each sequential read, up to the process's readahead() limit,
+// and closes again on a seek.
+static void
+readahead(struct inode *ip, uint off, uint n)
+{
+  uint bn, last, end, lim, b;
+
+  bn = off / BSIZE;
+  last = (off + n - 1) / BSIZE;
+  if(bn == ip->ranext)
+    ip->rawin = ip->rawin ? 2*ip->rawin : 2;
+  else if(bn + 1 != ip->ranext){
+    // Not sequential (a read within the last block does not count).
+    ip->rawin = 0;
+    ip->raend = 0;
+  }
+  ip->ranext = last + 1;
+  lim = myproc()->ramax;
+  if(ip->rawin > lim)
+    ip->rawin = lim;
+  if(ip->rawin == 0)
+    return;
+
+  end = min(last + 1 + ip->rawin, (ip->size + BSIZE - 1) / BSIZE);
+  for(b = last + 1 > ip->raend ? last + 1 : ip->raend; b < end; b++)
+    breadahead(ip->dev, bmap(ip, b));
+  if(end > ip->raend)
+    ip->raend = end;
+}
+
 //PAGEBREAK!
 // Read data from inode.
 // Caller must hold ip->lock.
 int
 readi(struct inode *ip, char *dst, uint off, uint n)
 {
-  uint tot, m;
+  uint tot, m, q, last, lim, off0;
   struct buf *bp;
 
   if(ip->type == T_DEV){
@@ -466,23 +1057,43 @@ readi(struct inode *ip, char *dst, uint off, uint n)
     return -1;
   if(off + n > ip->size)
     n = ip->size - off;
+  if(n == 0)
+    return 0;
 
+  // Keep the reads of up to the readahead window's worth of the
+  // blocks asked for queued ahead of the one being copied, so the
+  // blocks of an extent go to the disk back to back.  Queueing
+  // all of a large request could recycle its first blocks before
+  // they were copied.
+  off0 = off;
+  q = off/BSIZE + 1;
+  last = (off + n - 1)/BSIZE;
+  lim = myproc()->ramax;
   for(tot=0; tot<n; tot+=m, off+=m, dst+=m){
+    for(; q <= last && q <= off/BSIZE + lim; q++)
+      breadahead(ip->dev, bmap(ip, q));
     bp = bread(ip->dev, bmap(ip, off/BSIZE));
     m = min(n - tot, BSIZE - off%BSIZE);
     memmove(dst, bp->data + off%BSIZE, m);
     brelse(bp);
   }
+  readahead(ip, off0, n);
   return n;
 }
 
 // PAGEBREAK!
 // Write data to inode.
 // Caller must hold ip->lock.
+// Regular file data goes home with log_data(); only directory
+// contents are logged.  A block starting at or past the end of
+// the file, which includes every block bmap() allocates, is
+// filled in without reading its old contents.
+// Returns the number of bytes written, which is short if the
+// file could not grow far enough.
 int
 writei(struct inode *ip, char *src, uint off, uint n)
 {
-  uint tot, m;
+  uint tot, m, addr;
   struct buf *bp;
 
   if(ip->type == T_DEV){
@@ -497,18 +1108,27 @@ writei(struct inode *ip, char *src, uint off, uint n)
     return -1;
 
   for(tot=0; tot<n; tot+=m, off+=m, src+=m){
-    bp = bread(ip->dev, bmap(ip, off/BSIZE));
+    if((addr = bmap(ip, off/BSIZE)) == 0)
+      break;
+    if(off%BSIZE == 0 && off >= ip->size)
+      bp = bclear(ip->dev, addr);
+    else
+      bp = bread(ip->dev, addr);
     m = min(n - tot, BSIZE - off%BSIZE);
     memmove(bp->data + off%BSIZE, src, m);
-    log_write(bp);
-    brelse(bp);
+    if(ip->type == T_FILE)
+      log_data(bp);  // releases bp
+    else {
+      log_write(bp);
+      brelse(bp);
+    }
   }
 
-  if(n > 0 && off > ip->size){
+  if(tot > 0 && off > ip->size){
     ip->size = off;
     iupdate(ip);
   }
-  return n;
+  return tot;
 }
 
 //PAGEBREAK!
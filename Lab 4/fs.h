@@ -19,11 +19,17 @@ struct superblock {
   uint logstart;     // Block number of first log block
   uint inodestart;   // Block number of first inode block
   uint bmapstart;    // Block number of first free map block
+  uint swapstart;    // Block number of first swap block
+  uint nswap;        // Number of swap blocks
+  uint flags;        // FS_* format flags
 };
 
-#define NDIRECT 12
+#define FS_EXTENTS 1  // files are mapped by extents (mkfs -e)
+
+#define NDIRECT 11
 #define NINDIRECT (BSIZE / sizeof(uint))
-#define MAXFILE (NDIRECT + NINDIRECT)
+#define NDINDIRECT (NINDIRECT * NINDIRECT)
+#define MAXFILE (NDIRECT + NINDIRECT + NDINDIRECT)
 
 // On-disk inode structure
 struct dinode {
@@ -32,9 +38,29 @@ struct dinode {
   short minor;          // Minor device number (T_DEV only)
   short nlink;          // Number of links to inode in file system
   uint size;            // Size of file (bytes)
-  uint addrs[NDIRECT+1];   // Data block addresses
+  uint addrs[NDIRECT+2];   // Data block addresses
+};
+
+// In a file system with FS_EXTENTS, an inode's addrs[] holds
+// NIEXTENT extents, runs of contiguous blocks in file order,
+// then the block number of an extent index block.  The index
+// lists leaf blocks of NXLEAF more extents each, for files too
+// fragmented for the inode.
+struct extent {
+  uint start;   // first block of the run
+  uint len;     // blocks in the run; 0 if unused
 };
 
+struct xindex {
+  uint bn;      // first file block the leaf maps
+  uint leaf;    // leaf block #, or 0 if unused
+};
+
+#define NIEXTENT ((NDIRECT+1) / 2)
+#define XINDEX   (NDIRECT+1)  // addrs[] entry for the index block
+#define NXLEAF   (BSIZE / sizeof(struct extent))
+#define NXINDEX  (BSIZE / sizeof(struct xindex))
+
 // Inodes per block.
 #define IPB           (BSIZE / sizeof(struct dinode))
 
@@ -55,3 +81,11 @@ struct dirent {
   char name[DIRSIZ];
 };
 
+
+// Crash points for logcrash(): the next commit stops the machine
+// after writing the log blocks but not the header, after writing
+// the header but only half of the log blocks, or after committing
+// but before installing anything.
+#define LOGCRASH_NOHEAD    1
+#define LOGCRASH_TORN      2
+#define LOGCRASH_NOINSTALL 3
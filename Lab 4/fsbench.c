@@ -0,0 +1,88 @@
+// Read small files in parallel and report the ticks taken.
+// Each reader opens and reads its own file over and over; the
+// files fit in the buffer cache, so after the first pass this
+// measures the cost of finding blocks in the cache.  Every reader
+// does the same work, so with enough CPUs the time should stay
+// flat as readers are added.
+//
+// usage: fsbench [readers]
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+
+#define FILEBLOCKS 4
+#define ROUNDS     2000
+
+static char buf[512];
+
+static void
+name(char *path, int i)
+{
+  strcpy(path, "fsbench.0");
+  path[8] = '0' + i;
+}
+
+static void
+reader(int i)
+{
+  char path[16];
+  int fd, r;
+
+  name(path, i);
+  for(r = 0; r < ROUNDS; r++){
+    if((fd = open(path, O_RDONLY)) < 0){
+      printf(2, "fsbench: cannot open %s\n", path);
+      exit();
+    }
+    while(read(fd, buf, sizeof(buf)) > 0)
+      ;
+    close(fd);
+  }
+}
+
+int
+main(int argc, char *argv[])
+{
+  char path[16];
+  int i, j, n, fd, t;
+
+  n = 4;
+  if(argc > 1)
+    n = atoi(argv[1]);
+  if(n <= 0 || n > 10){
+    printf(2, "usage: fsbench [readers], at most 10\n");
+    exit();
+  }
+
+  for(i = 0; i < n; i++){
+    name(path, i);
+    if((fd = open(path, O_CREATE|O_RDWR)) < 0){
+      printf(2, "fsbench: cannot create %s\n", path);
+      exit();
+    }
+    for(j = 0; j < FILEBLOCKS; j++)
+      write(fd, buf, sizeof(buf));
+    close(fd);
+  }
+
+  for(i = 1; i <= n; i++){
+    t = uptime();
+    for(j = 0; j < i; j++){
+      if(fork() == 0){
+        reader(j);
+        exit();
+      }
+    }
+    for(j = 0; j < i; j++)
+      wait();
+    printf(1, "%d readers: %d ticks\n", i, uptime() - t);
+  }
+
+  for(i = 0; i < n; i++){
+    name(path, i);
+    unlink(path);
+  }
+  exit();
+}
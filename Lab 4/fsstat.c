@@ -0,0 +1,39 @@
+// Print buffer cache statistics: how many buffers the cache holds
+// and may grow to, the share of block lookups it satisfied, how
+// many blocks were read ahead, and how many buffers it gave back
+// when memory ran low.  Then the log: transactions committed,
+// blocks written to the log and blocks written home from it, and
+// file blocks written home without going through the log, and
+// the free disk blocks.  Last, the inode cache: how many entries
+// it holds and may grow to, and the share of lookups it satisfied.
+
+#include "types.h"
+#include "fsstat.h"
+#include "user.h"
+
+int
+main(int argc, char *argv[])
+{
+  struct fsstat st;
+  uint total;
+
+  if(fsstat(&st) < 0){
+    printf(2, "fsstat: failed\n");
+    exit();
+  }
+  total = st.nhit + st.nmiss;
+  printf(1, "buffers %d of %d (%d KB)\n", st.nbuf, st.maxbuf, st.nbuf/2);
+  printf(1, "lookups %d hits %d misses %d (%d%% hits)\n", total,
+         st.nhit, st.nmiss, total ? st.nhit*100/total : 0);
+  printf(1, "readahead %d\n", st.nreadahead);
+  printf(1, "shrunk %d\n", st.nshrunk);
+  printf(1, "commits %d logged %d installed %d\n", st.ncommit,
+         st.nlogwrite, st.ninstall);
+  printf(1, "file blocks written %d\n", st.ndatawrite);
+  printf(1, "free blocks %d (%d KB)\n", st.nfreeblock, st.nfreeblock/2);
+  total = st.nihit + st.nimiss;
+  printf(1, "inodes %d of %d\n", st.ninode, st.maxinode);
+  printf(1, "inode lookups %d hits %d misses %d (%d%% hits)\n", total,
+         st.nihit, st.nimiss, total ? st.nihit*100/total : 0);
+  exit();
+}
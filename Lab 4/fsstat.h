@@ -0,0 +1,19 @@
+// File system cache statistics,
+// filled in by the fsstat() system call.
+struct fsstat {
+  uint nbuf;        // buffers in the block cache
+  uint maxbuf;      // most buffers the cache may grow to
+  uint nhit;        // block lookups found in the cache
+  uint nmiss;       // ... and lookups that were not
+  uint nreadahead;  // blocks read ahead of sequential readers
+  uint nshrunk;     // buffers freed because memory was low
+  uint ncommit;     // log transactions committed
+  uint nlogwrite;   // blocks written to the log
+  uint ninstall;    // blocks written home from the log
+  uint ndatawrite;  // file blocks written home, not logged
+  uint nfreeblock;  // free disk blocks
+  uint ninode;      // entries in the inode cache
+  uint maxinode;    // most entries the cache may grow to
+  uint nihit;       // inode lookups found in the cache
+  uint nimiss;      // ... and lookups that were not
+};
@@ -75,7 +75,7 @@ idestart(struct buf *b)
 {
   if(b == 0)
     panic("idestart");
-  if(b->blockno >= FSSIZE)
+  if(b->blockno >= FSSIZE + SWAPSIZE)
     panic("incorrect blockno");
   int sector_per_block =  BSIZE/SECTOR_SIZE;
   int sector = b->blockno * sector_per_block;
@@ -118,10 +118,13 @@ ideintr(void)
   if(!(b->flags & B_DIRTY) && idewait(1) >= 0)
     insl(0x1f0, b->data, BSIZE/4);
 
-  // Wake process waiting for this buf.
+  // Wake process waiting for this buf, or release it if no one is.
   b->flags |= B_VALID;
   b->flags &= ~B_DIRTY;
-  wakeup(b);
+  if(b->flags & B_ASYNC)
+    bdone(b);
+  else
+    wakeup(b);
 
   // Start disk on next buf in queue.
   if(idequeue != 0)
@@ -134,6 +137,8 @@ ideintr(void)
 // Sync buf with disk.
 // If B_DIRTY is set, write buf to disk, clear B_DIRTY, set B_VALID.
 // Else if B_VALID is not set, read buf from disk, set B_VALID.
+// If B_ASYNC is set, return at once; ideintr() hands the buf
+// to bdone() when the request is finished.
 void
 iderw(struct buf *b)
 {
@@ -158,6 +163,11 @@ iderw(struct buf *b)
   if(idequeue == b)
     idestart(b);
 
+  if(b->flags & B_ASYNC){
+    release(&idelock);
+    return;
+  }
+
   // Wait for request to finish.
   while((b->flags & (B_VALID|B_DIRTY)) != B_VALID){
     sleep(b, &idelock);
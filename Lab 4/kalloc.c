@@ -1,6 +1,13 @@
 // Physical memory allocator, intended to allocate
 // memory for user processes, kernel stacks, page table pages,
-// and pipe buffers. Allocates 4096-byte pages.
+// and pipe buffers. Allocates blocks of 2^order 4096-byte pages
+// using a binary buddy system; kalloc() hands out single pages.
+//
+// The kzerod kernel thread keeps a pool of up to ZEROPOOL free
+// pages that it has already zeroed, one page at a time between
+// other processes' turns, so that kalloc_zeroed() usually need not
+// clear a page while a process waits.  Pool pages are still free
+// memory: kalloc() falls back on them when the free lists are empty.
 
 #include "types.h"
 #include "defs.h"
@@ -8,21 +15,37 @@
 #include "memlayout.h"
 #include "mmu.h"
 #include "spinlock.h"
+#include "kmemstat.h"
 
 void freerange(void *vstart, void *vend);
 extern char end[]; // first address after kernel loaded from ELF file
                    // defined by the kernel linker script in kernel.ld
 
+#define NPAGE   (PHYSTOP/PGSIZE)
+#define KP_FREE 0x80   // pageinfo[]: page heads a free block
+
 struct run {
   struct run *next;
+  struct run *prev;
 };
 
 struct {
   struct spinlock lock;
   int use_lock;
-  struct run *freelist;
+  struct run free[MAXORDER+1];  // circular lists of free blocks
+  uint nblocks[MAXORDER+1];     // length of each list
+  uint npages;                  // pages handed to the allocator
+  uint nfree;                   // pages on the free lists
+  struct run *zeroed;           // zeroed pages, linked through next
+  uint nzeroed;
+  uint zhits;                   // kalloc_zeroed() served from the pool
+  uint zmisses;                 // ... or not
 } kmem;
 
+// For the first page of each free block, KP_FREE|order.
+// Zero for every other page.
+static uchar pageinfo[NPAGE];
+
 // Initialization happens in two phases.
 // 1. main() calls kinit1() while still using entrypgdir to place just
 // the pages mapped by entrypgdir on free list.
@@ -31,8 +54,12 @@ struct {
 void
 kinit1(void *vstart, void *vend)
 {
+  int k;
+
   initlock(&kmem.lock, "kmem");
   kmem.use_lock = 0;
+  for(k = 0; k <= MAXORDER; k++)
+    kmem.free[k].next = kmem.free[k].prev = &kmem.free[k];
   freerange(vstart, vend);
 }
 
@@ -48,34 +75,125 @@ freerange(void *vstart, void *vend)
 {
   char *p;
   p = (char*)PGROUNDUP((uint)vstart);
-  for(; p + PGSIZE <= (char*)vend; p += PGSIZE)
+  for(; p + PGSIZE <= (char*)vend; p += PGSIZE){
+    kmem.npages++;
     kfree(p);
+  }
+}
+
+static void
+pushblock(struct run *r, int order)
+{
+  struct run *h = &kmem.free[order];
+
+  r->next = h->next;
+  r->prev = h;
+  h->next->prev = r;
+  h->next = r;
+  kmem.nblocks[order]++;
+  pageinfo[V2P(r)/PGSIZE] = KP_FREE | order;
+}
+
+static void
+unlinkblock(struct run *r, int order)
+{
+  r->prev->next = r->next;
+  r->next->prev = r->prev;
+  kmem.nblocks[order]--;
+  pageinfo[V2P(r)/PGSIZE] = 0;
 }
+
+// Take a block of the given order off the free lists,
+// splitting a larger block if necessary.
+// Caller must hold kmem.lock (if in use).
+static struct run*
+takeblock(int order)
+{
+  struct run *r;
+  int k;
+
+  for(k = order; k <= MAXORDER; k++)
+    if(kmem.free[k].next != &kmem.free[k])
+      break;
+  if(k > MAXORDER)
+    return 0;
+  r = kmem.free[k].next;
+  unlinkblock(r, k);
+  // Give back the upper halves we don't need.
+  while(k > order){
+    k--;
+    pushblock((struct run*)((char*)r + (PGSIZE << k)), k);
+  }
+  kmem.nfree -= 1 << order;
+  return r;
+}
+
 //PAGEBREAK: 21
-// Free the page of physical memory pointed at by v,
+// Free the block of 2^order pages pointed at by v,
 // which normally should have been returned by a
-// call to kalloc().  (The exception is when
+// call to kalloc_order().  (The exception is when
 // initializing the allocator; see kinit above.)
+// The block is merged with its buddy for as long
+// as the buddy is free too.
 void
-kfree(char *v)
+kfree_order(char *v, int order)
 {
-  struct run *r;
+  uint pi, bi;
+  struct run *b;
 
-  if((uint)v % PGSIZE || v < end || V2P(v) >= PHYSTOP)
+  if(order < 0 || order > MAXORDER)
+    panic("kfree_order");
+  if((uint)v % (PGSIZE << order) || v < end ||
+     V2P(v) + (PGSIZE << order) > PHYSTOP)
     panic("kfree");
 
   // Fill with junk to catch dangling refs.
-  memset(v, 1, PGSIZE);
+  memset(v, 1, PGSIZE << order);
 
   if(kmem.use_lock)
     acquire(&kmem.lock);
-  r = (struct run*)v;
-  r->next = kmem.freelist;
-  kmem.freelist = r;
+  kmem.nfree += 1 << order;
+  pi = V2P(v) / PGSIZE;
+  while(order < MAXORDER){
+    bi = pi ^ (1 << order);
+    if(bi >= NPAGE || pageinfo[bi] != (KP_FREE | order))
+      break;
+    b = (struct run*)P2V(bi * PGSIZE);
+    unlinkblock(b, order);
+    pi &= ~(1 << order);
+    order++;
+  }
+  pushblock((struct run*)P2V(pi * PGSIZE), order);
   if(kmem.use_lock)
     release(&kmem.lock);
 }
 
+// Free the page of physical memory pointed at by v.
+void
+kfree(char *v)
+{
+  kfree_order(v, 0);
+}
+
+// Allocate a physically contiguous block of 2^order pages,
+// aligned to its size.
+// Returns a pointer that the kernel can use.
+// Returns 0 if the memory cannot be allocated.
+char*
+kalloc_order(int order)
+{
+  struct run *r;
+
+  if(order < 0 || order > MAXORDER)
+    return 0;
+  if(kmem.use_lock)
+    acquire(&kmem.lock);
+  r = takeblock(order);
+  if(kmem.use_lock)
+    release(&kmem.lock);
+  return (char*)r;
+}
+
 // Allocate one 4096-byte page of physical memory.
 // Returns a pointer that the kernel can use.
 // Returns 0 if the memory cannot be allocated.
@@ -86,11 +204,110 @@ kalloc(void)
 
   if(kmem.use_lock)
     acquire(&kmem.lock);
-  r = kmem.freelist;
-  if(r)
-    kmem.freelist = r->next;
+  r = kmem.free[0].next;
+  if(r != &kmem.free[0]){
+    // Fast path: a single page is already on the order-0 list.
+    unlinkblock(r, 0);
+    kmem.nfree--;
+  } else if((r = takeblock(0)) == 0 && (r = kmem.zeroed) != 0){
+    kmem.zeroed = r->next;
+    kmem.nzeroed--;
+  }
   if(kmem.use_lock)
     release(&kmem.lock);
+  if(kfreepages() < SWAPLOW)
+    swapwake();
   return (char*)r;
 }
 
+// Allocate one page of physical memory filled with zeros,
+// from kzerod's pool if it has one ready.
+// Returns 0 if the memory cannot be allocated.
+char*
+kalloc_zeroed(void)
+{
+  struct run *r;
+  int low;
+
+  if(kmem.use_lock)
+    acquire(&kmem.lock);
+  if((r = kmem.zeroed) != 0){
+    kmem.zeroed = r->next;
+    kmem.nzeroed--;
+    kmem.zhits++;
+  } else
+    kmem.zmisses++;
+  low = kmem.nzeroed < ZEROPOOL/2;
+  if(kmem.use_lock)
+    release(&kmem.lock);
+
+  if(r)
+    r->next = 0;  // the only word the pool wrote to
+  else if((r = (struct run*)kalloc()) != 0)
+    memset(r, 0, PGSIZE);
+  if(low && kmem.use_lock)
+    wakeup(&kmem.zeroed);
+  return (char*)r;
+}
+
+static void
+kzerod(void)
+{
+  struct run *r;
+
+  for(;;){
+    acquire(&kmem.lock);
+    while(kmem.nzeroed >= ZEROPOOL)
+      sleep(&kmem.zeroed, &kmem.lock);
+    if(kmem.nfree <= SWAPHIGH){
+      // Memory is short; don't take pages kswapd is freeing up.
+      release(&kmem.lock);
+      acquire(&tickslock);
+      sleep(&ticks, &tickslock);
+      release(&tickslock);
+      continue;
+    }
+    r = takeblock(0);
+    release(&kmem.lock);
+
+    memset(r, 0, PGSIZE);
+
+    acquire(&kmem.lock);
+    r->next = kmem.zeroed;
+    kmem.zeroed = r;
+    kmem.nzeroed++;
+    release(&kmem.lock);
+    yield();  // only zero while nobody else wants the cpu
+  }
+}
+
+// Start kzerod.  Called once, after the first process exists.
+void
+kzeroinit(void)
+{
+  kthread("kzerod", kzerod);
+}
+
+// Number of free pages, counting the zeroed pool.
+uint
+kfreepages(void)
+{
+  return kmem.nfree + kmem.nzeroed;
+}
+
+// Copy out the allocator's free-block statistics.
+void
+kmemstat(struct kmemstat *st)
+{
+  int k;
+
+  acquire(&kmem.lock);
+  st->npages = kmem.npages;
+  st->nfree = kmem.nfree;
+  for(k = 0; k <= MAXORDER; k++)
+    st->nblocks[k] = kmem.nblocks[k];
+  st->nzeroed = kmem.nzeroed;
+  st->zhits = kmem.zhits;
+  st->zmisses = kmem.zmisses;
+  release(&kmem.lock);
+}
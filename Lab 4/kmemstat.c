@@ -0,0 +1,39 @@
+// Print the physical page allocator's free lists.
+// For each order, "usable" is the share of free memory that
+// could satisfy a request of that many contiguous pages;
+// the rest is lost to fragmentation.
+// Then the pool of pages zeroed ahead of time, and how often
+// kalloc_zeroed() found one there.  Swap usage is printed last.
+
+#include "types.h"
+#include "param.h"
+#include "kmemstat.h"
+#include "user.h"
+
+int
+main(int argc, char *argv[])
+{
+  struct kmemstat st;
+  uint above;
+  int k, j;
+
+  if(kmemstat(&st) < 0){
+    printf(2, "kmemstat: failed\n");
+    exit();
+  }
+  printf(1, "pages %d free %d (%d KB)\n", st.npages, st.nfree, st.nfree*4);
+  printf(1, "order  blocks  usable\n");
+  for(k = 0; k <= MAXORDER; k++){
+    above = 0;
+    for(j = k; j <= MAXORDER; j++)
+      above += st.nblocks[j] << j;
+    printf(1, "%d\t%d\t%d%%\n", k, st.nblocks[k],
+           st.nfree ? above*100/st.nfree : 0);
+  }
+  printf(1, "zeroed %d pages, %d hits, %d misses (%d%% hit)\n",
+         st.nzeroed, st.zhits, st.zmisses,
+         st.zhits + st.zmisses ? st.zhits*100/(st.zhits + st.zmisses) : 0);
+  printf(1, "swap %d of %d pages used, %d paged in, %d paged out\n",
+         st.swapused, st.nswap, st.npagein, st.npageout);
+  exit();
+}
@@ -0,0 +1,15 @@
+// Physical memory allocator statistics,
+// filled in by the kmemstat() system call.
+// Include param.h first for MAXORDER.
+struct kmemstat {
+  uint npages;                // pages managed by the allocator
+  uint nfree;                 // pages currently free
+  uint nblocks[MAXORDER+1];   // free blocks of 2^order pages
+  uint nzeroed;               // free pages zeroed ahead of time
+  uint zhits;                 // kalloc_zeroed() calls served from them
+  uint zmisses;               // ... and calls that had to zero a page
+  uint nswap;                 // swap slots (pages)
+  uint swapused;              // swap slots in use
+  uint npagein;               // pages read back from swap
+  uint npageout;              // pages written to swap
+};
@@ -5,6 +5,7 @@
 #include "sleeplock.h"
 #include "fs.h"
 #include "buf.h"
+#include "fsstat.h"
 
 // Simple logging that allows concurrent FS system calls.
 //
@@ -18,37 +19,112 @@
 // its start and end. Usually begin_op() just increments
 // the count of in-progress FS system calls and returns.
 // But if it thinks the log is close to running out, it
-// sleeps until the last outstanding end_op() commits.
+// sleeps until the last outstanding end_op() commits,
+// or the flusher frees some log space.
 //
 // The log is a physical re-do log containing disk blocks.
 // The on-disk log format:
-//   header block, containing block #s for block A, B, C, ...
-//   block A
-//   block B
-//   block C
+//   header block, containing for slots 1, 2, 3, ...
+//     the home block #, the transaction and a checksum
+//   slot 1
+//   slot 2
+//   slot 3
 //   ...
-// Log appends are synchronous.
+// A block # of 0 marks an unused slot.
+//
+// A commit queues its log blocks and the header at once and waits
+// for all of them together, so the disk may write them in any
+// order.  Recovery installs transactions oldest first and stops at
+// the first one whose slots do not match their checksums: the
+// header reached the disk but not all of its blocks did.  So a
+// header keeps listing a block's older committed copy until a
+// header listing the newer copy is known to be on disk.
+//
+// Two transactions can be in memory at once.  A commit first
+// copies the transaction's blocks into log buffers, with no FS
+// system call running; after that, new system calls join the next
+// transaction while this one's log blocks and header go to disk.
+// If the next transaction is complete by then, the committing
+// process commits it too.
+//
+// The modified blocks stay in the buffer cache, pinned with
+// B_DIRTY, and the flusher kernel thread writes them to their home
+// locations later, in block order, once the log is half full or
+// someone is waiting for space.  Each transaction that modifies a
+// block gives it a new slot; only the newest committed copy is
+// listed in the header or installed.  A slot is reused only after
+// a header that no longer lists it has been written, so recovery
+// never installs a slot that is being rewritten.
+//
+// Only metadata goes through the log.  writei() sends regular
+// file data straight to its home location with log_data(), and
+// commit() waits for those writes before the header, so a
+// committed inode never points at a block that has not been
+// written.  For the same reason a block freed by a transaction is
+// not allocated again until that transaction has committed: the
+// old owner still has it on disk until then.  log_free() notes
+// the block, and bfreed() hands it back to balloc() after the
+// commit.
 
-// Contents of the header block, used for both the on-disk header block
-// and to keep track in memory of logged block# before commit.
+// Contents of the header block, used for the on-disk header block.
 struct logheader {
   int n;
-  int block[LOGSIZE];
+  struct {
+    int block;   // home block #, or 0
+    uint seq;    // transaction that wrote the slot
+    uint sum;    // checksum of the slot's contents
+  } slot[LOGSIZE];
+};
+
+// File blocks a transaction can wait for at commit; log_data()
+// writes any more synchronously.
+#define NDATA (MAXOPDATA*LOGSIZE/MAXOPBLOCKS)
+
+// State of a log slot.
+enum {
+  SLOT_FREE,        // not in the on-disk header; may be reused
+  SLOT_PENDING,     // updated by the open transaction
+  SLOT_COMMITTING,  // copied to its log buffer, being committed
+  SLOT_COMMITTED,   // in the log; home location not yet written
+  SLOT_INSTALLED,   // written home; free after the next header
 };
 
 struct log {
   struct spinlock lock;
   int start;
   int size;
+  int nslot;       // usable log slots
   int outstanding; // how many FS sys calls are executing.
-  int committing;  // in commit(), please wait.
+  int committing;  // in commit() copying blocks, please wait.
+  int writing;     // in commit() writing the log
+  int waiting;     // begin_op() calls waiting for log space
   int dev;
-  struct logheader lh;
+  int nused;       // slots not SLOT_FREE
+  int npending;    // slots SLOT_PENDING
+  uint seq;        // number of the open transaction
+  int block[LOGSIZE];  // home block # of each slot
+  uint slotseq[LOGSIZE];  // transaction that wrote each slot
+  uint sum[LOGSIZE];      // checksum of each slot's contents
+  char state[LOGSIZE];
+  char flushwait;  // the flusher sleeps on this
+  struct sleeplock headlock;  // serializes header writes
+  uint ncommit;
+  uint nlogwrite;  // blocks written to the log
+  uint ninstall;   // blocks written home by the flusher
+  uint ndatawrite; // file blocks written home by log_data()
+  int crash;       // crash point for the next commit (logcrash())
+  // The open and the committing transaction's file blocks and
+  // freed blocks, indexed by the transaction's seq & 1.
+  int ndata[2];
+  int data[2][NDATA];
+  uchar freed[2][(FSSIZE+7)/8];
 };
 struct log log;
 
 static void recover_from_log(void);
 static void commit();
+static void done_trans(int);
+static void flusher(void);
 
 void
 initlog(int dev)
@@ -58,67 +134,186 @@ initlog(int dev)
 
   struct superblock sb;
   initlock(&log.lock, "log");
+  initsleeplock(&log.headlock, "loghead");
   readsb(dev, &sb);
   log.start = sb.logstart;
   log.size = sb.nlog;
+  log.nslot = log.size - 1 < LOGSIZE ? log.size - 1 : LOGSIZE;
   log.dev = dev;
   recover_from_log();
+  kthread("flusher", flusher);
 }
 
-// Copy committed blocks from log to their home location
+// Checksum of a block's contents (FNV-1a).
+static uint
+logsum(uchar *data)
+{
+  uint h;
+  int i;
+
+  h = 2166136261U;
+  for (i = 0; i < BSIZE; i++)
+    h = (h ^ data[i]) * 16777619;
+  return h;
+}
+
+// Copy committed blocks from log to their home location, one
+// transaction at a time, oldest first.  Stop at the first torn
+// transaction: it did not commit, and neither did any later one.
 static void
-install_trans(void)
+install_trans(struct logheader *lh)
 {
-  int tail;
+  struct buf *lbuf, *dbuf;
+  uint seq, next;
+  int tail, torn;
+
+  for (seq = 0; ; seq = next + 1) {
+    // Find the oldest transaction left.
+    next = 0xffffffff;
+    for (tail = 0; tail < lh->n; tail++)
+      if (lh->slot[tail].block && lh->slot[tail].seq >= seq &&
+         lh->slot[tail].seq < next)
+        next = lh->slot[tail].seq;
+    if (next == 0xffffffff)
+      return;
+
+    torn = 0;
+    for (tail = 0; tail < lh->n; tail++) {
+      if (lh->slot[tail].block == 0 || lh->slot[tail].seq != next)
+        continue;
+      lbuf = bread(log.dev, log.start+tail+1); // read log block
+      if (logsum(lbuf->data) != lh->slot[tail].sum)
+        torn = 1;
+      brelse(lbuf);
+    }
+    if (torn) {
+      cprintf("log: transaction %d torn, discarded\n", next);
+      return;
+    }
 
-  for (tail = 0; tail < log.lh.n; tail++) {
-    struct buf *lbuf = bread(log.dev, log.start+tail+1); // read log block
-    struct buf *dbuf = bread(log.dev, log.lh.block[tail]); // read dst
-    memmove(dbuf->data, lbuf->data, BSIZE);  // copy block to dst
-    bwrite(dbuf);  // write dst to disk
-    brelse(lbuf);
-    brelse(dbuf);
+    for (tail = 0; tail < lh->n; tail++) {
+      if (lh->slot[tail].block == 0 || lh->slot[tail].seq != next)
+        continue;
+      lbuf = bread(log.dev, log.start+tail+1); // read log block
+      dbuf = bread(log.dev, lh->slot[tail].block); // read dst
+      memmove(dbuf->data, lbuf->data, BSIZE);  // copy block to dst
+      bwrite(dbuf);  // write dst to disk
+      brelse(lbuf);
+      brelse(dbuf);
+    }
   }
 }
 
-// Read the log header from disk into the in-memory log header
+// Read the log header from disk
 static void
-read_head(void)
+read_head(struct logheader *lh)
 {
   struct buf *buf = bread(log.dev, log.start);
-  struct logheader *lh = (struct logheader *) (buf->data);
+  struct logheader *hb = (struct logheader *) (buf->data);
   int i;
-  log.lh.n = lh->n;
-  for (i = 0; i < log.lh.n; i++) {
-    log.lh.block[i] = lh->block[i];
+  lh->n = hb->n;
+  if (lh->n < 0 || lh->n > LOGSIZE)
+    lh->n = 0;
+  for (i = 0; i < lh->n; i++) {
+    lh->slot[i] = hb->slot[i];
   }
   brelse(buf);
 }
 
-// Write in-memory log header to disk.
-// This is the true point at which the
-// current transaction commits.
-static void
-write_head(void)
+// Copy a log header into its buffer, locked.
+static struct buf*
+fill_head(struct logheader *lh)
 {
   struct buf *buf = bread(log.dev, log.start);
   struct logheader *hb = (struct logheader *) (buf->data);
   int i;
-  hb->n = log.lh.n;
-  for (i = 0; i < log.lh.n; i++) {
-    hb->block[i] = log.lh.block[i];
+  hb->n = lh->n;
+  for (i = 0; i < lh->n; i++) {
+    hb->slot[i] = lh->slot[i];
   }
+  return buf;
+}
+
+// Write a log header to disk.
+static void
+write_head(struct logheader *lh)
+{
+  struct buf *buf = fill_head(lh);
   bwrite(buf);
   brelse(buf);
 }
 
+// Wait for the asynchronous write of blockno started by bawrite():
+// the buffer stays locked until the write is done.
+static void
+wait_write(int blockno)
+{
+  brelse(bread(log.dev, blockno));
+}
+
+// Is slot s the newest copy of its block among the slots whose
+// state is in the bit mask states?  Caller holds log.lock.
+static int
+newest(int s, int states)
+{
+  int i;
+
+  for (i = 0; i < log.nslot; i++) {
+    if ((states & (1 << log.state[i])) && log.block[i] == log.block[s] &&
+       log.slotseq[i] > log.slotseq[s])
+      return 0;
+  }
+  return 1;
+}
+
+#define COMMITTED ((1 << SLOT_COMMITTED) | (1 << SLOT_INSTALLED))
+#define INUSE     (~(1 << SLOT_FREE))
+
+// Build a header listing the newest committed copy of each block,
+// unless that copy has been installed.  commit() also lists the
+// slots it is committing; until they are known to be on disk, the
+// copies they supersede are still the newest.  Caller holds
+// log.lock.
+static void
+make_head(struct logheader *lh, int committing)
+{
+  int i, list;
+
+  lh->n = log.nslot;
+  for (i = 0; i < log.nslot; i++) {
+    list = (log.state[i] == SLOT_COMMITTED && newest(i, COMMITTED)) ||
+           (committing && log.state[i] == SLOT_COMMITTING);
+    lh->slot[i].block = list ? log.block[i] : 0;
+    lh->slot[i].seq = log.slotseq[i];
+    lh->slot[i].sum = log.sum[i];
+  }
+}
+
+// A header lh has been written: committed slots it does not list
+// are free now.  Caller holds log.lock.
+static void
+free_slots(struct logheader *lh)
+{
+  int i;
+
+  for (i = 0; i < log.nslot; i++) {
+    if ((COMMITTED & (1 << log.state[i])) && lh->slot[i].block == 0) {
+      log.state[i] = SLOT_FREE;
+      log.nused--;
+    }
+  }
+  wakeup(&log);
+}
+
 static void
 recover_from_log(void)
 {
-  read_head();
-  install_trans(); // if committed, copy from log to disk
-  log.lh.n = 0;
-  write_head(); // clear the log
+  struct logheader lh;
+
+  read_head(&lh);
+  install_trans(&lh); // if committed, copy from log to disk
+  lh.n = 0;
+  write_head(&lh); // clear the log
 }
 
 // called at the start of each FS system call.
@@ -129,9 +324,13 @@ begin_op(void)
   while(1){
     if(log.committing){
       sleep(&log, &log.lock);
-    } else if(log.lh.n + (log.outstanding+1)*MAXOPBLOCKS > LOGSIZE){
-      // this op might exhaust log space; wait for commit.
+    } else if(log.nused + (log.outstanding+1)*MAXOPBLOCKS > log.nslot){
+      // this op might exhaust log space; wait for commit
+      // or for the flusher.
+      log.waiting++;
+      wakeup(&log.flushwait);
       sleep(&log, &log.lock);
+      log.waiting--;
     } else {
       log.outstanding += 1;
       release(&log.lock);
@@ -141,7 +340,9 @@ begin_op(void)
 }
 
 // called at the end of each FS system call.
-// commits if this was the last outstanding operation.
+// commits if this was the last outstanding operation,
+// unless another commit is still writing; that one
+// commits this transaction when it is done.
 void
 end_op(void)
 {
@@ -151,7 +352,7 @@ end_op(void)
   log.outstanding -= 1;
   if(log.committing)
     panic("log.committing");
-  if(log.outstanding == 0){
+  if(log.outstanding == 0 && !log.writing){
     do_commit = 1;
     log.committing = 1;
   } else {
@@ -162,48 +363,222 @@ end_op(void)
   }
   release(&log.lock);
 
-  if(do_commit){
+  while(do_commit){
     // call commit w/o holding locks, since not allowed
     // to sleep with locks.
     commit();
     acquire(&log.lock);
-    log.committing = 0;
+    log.writing = 0;
+    // System calls that ended while we were writing
+    // left their transaction for us.
+    do_commit = log.outstanding == 0 &&
+      (log.npending > 0 || log.ndata[log.seq & 1] > 0);
+    log.committing = do_commit;
     wakeup(&log);
     release(&log.lock);
   }
 }
 
-// Copy modified blocks from cache to log.
+// Commit the open transaction.  Called with log.committing set,
+// so no FS system call is running.
 static void
-write_log(void)
+commit()
 {
-  int tail;
+  struct logheader lh;
+  struct buf *to[LOGSIZE], *from, *hb;
+  int i, n, t, slot[LOGSIZE];
+
+  acquire(&log.lock);
+  n = 0;
+  for (i = 0; i < log.nslot; i++) {
+    if (log.state[i] == SLOT_PENDING) {
+      log.state[i] = SLOT_COMMITTING;
+      slot[n++] = i;
+    }
+  }
+  log.npending = 0;
+  t = log.seq++ & 1;   // later log_write()s are for the next transaction
+  release(&log.lock);
 
-  for (tail = 0; tail < log.lh.n; tail++) {
-    struct buf *to = bread(log.dev, log.start+tail+1); // log block
-    struct buf *from = bread(log.dev, log.lh.block[tail]); // cache block
-    memmove(to->data, from->data, BSIZE);
-    bwrite(to);  // write the log
+  // Copy modified blocks from cache to log buffers, while no one
+  // can modify them.
+  for (i = 0; i < n; i++) {
+    to[i] = bread(log.dev, log.start+slot[i]+1); // log block
+    from = bread(log.dev, log.block[slot[i]]); // cache block
+    memmove(to[i]->data, from->data, BSIZE);
     brelse(from);
-    brelse(to);
+    log.sum[slot[i]] = logsum(to[i]->data);
+  }
+
+  // Let the next transaction start while this one goes to disk.
+  acquire(&log.lock);
+  log.committing = 0;
+  log.writing = 1;
+  wakeup(&log);
+  release(&log.lock);
+
+  if (n == 0) {
+    // Only file data: nothing to log.
+    for (i = 0; i < log.ndata[t]; i++)
+      wait_write(log.data[t][i]);
+    done_trans(t);
+    return;
+  }
+
+  // Queue the log blocks and the header together, and wait for
+  // them all: the checksums make the order they land in harmless.
+  // The file data must be on disk before the header, though.
+  acquiresleep(&log.headlock);
+  acquire(&log.lock);
+  make_head(&lh, 1);
+  release(&log.lock);
+  hb = fill_head(&lh);
+  for (i = 0; i < n; i++) {
+    if (log.crash == LOGCRASH_TORN && i >= n/2)
+      brelse(to[i]);   // lost in the crash
+    else
+      bawrite(to[i]);  // write the log
   }
+  for (i = 0; i < log.ndata[t]; i++)
+    wait_write(log.data[t][i]);
+  if (log.crash == LOGCRASH_NOHEAD)
+    brelse(hb);
+  else
+    bawrite(hb);   // the real commit
+  for (i = 0; i < n; i++)
+    wait_write(log.start+slot[i]+1);
+  wait_write(log.start);
+  if (log.crash)
+    panic("log: crash injected");
+
+  acquire(&log.lock);
+  for (i = 0; i < n; i++)
+    log.state[slot[i]] = SLOT_COMMITTED;
+  free_slots(&lh);
+  log.ncommit++;
+  log.nlogwrite += n;
+  if (log.nused > log.nslot/2)
+    wakeup(&log.flushwait);
+  release(&log.lock);
+  releasesleep(&log.headlock);
+  done_trans(t);
 }
 
+// Transaction seq & 1 == t has committed: the blocks it freed
+// may be allocated again, and its file writes are done.  No one
+// else touches log.freed[t] until the next transaction starts.
 static void
-commit()
+done_trans(int t)
 {
-  if (log.lh.n > 0) {
-    write_log();     // Write modified blocks from cache to log
-    write_head();    // Write header to disk -- the real commit
-    install_trans(); // Now install writes to home locations
-    log.lh.n = 0;
-    write_head();    // Erase the transaction from the log
+  uint i, b;
+
+  for (i = 0; i < sizeof(log.freed[t]); i++)
+    for (b = i*8; log.freed[t][i] && b < i*8 + 8; b++)
+      if (log.freed[t][i] & (1 << (b%8)))
+        bfreed(b);
+  acquire(&log.lock);
+  log.ndata[t] = 0;
+  memset(log.freed[t], 0, sizeof(log.freed[t]));
+  release(&log.lock);
+}
+
+// If the log needs space, fill in the slots the flusher should
+// install, sorted by home block, with the transaction that wrote
+// each, and return how many.  Caller holds log.lock.
+static int
+flushable(int *slot, int *blockno, uint *seq)
+{
+  int i, j, n;
+
+  if (log.waiting == 0 && log.nused <= log.nslot/2)
+    return 0;
+  n = 0;
+  for (i = 0; i < log.nslot; i++) {
+    if (log.state[i] != SLOT_COMMITTED || !newest(i, INUSE))
+      continue;
+    for (j = n; j > 0 && blockno[j-1] > log.block[i]; j--) {
+      slot[j] = slot[j-1];
+      blockno[j] = blockno[j-1];
+      seq[j] = seq[j-1];
+    }
+    slot[j] = i;
+    blockno[j] = log.block[i];
+    seq[j] = log.slotseq[i];
+    n++;
+  }
+  return n;
+}
+
+// Is slot s, found by flushable() to hold blockno as written by
+// transaction seq, still committed and its block's newest copy?
+// Caller holds log.lock.
+static int
+stillflushable(int s, int blockno, uint seq)
+{
+  return log.state[s] == SLOT_COMMITTED && log.block[s] == blockno &&
+    log.slotseq[s] == seq && newest(s, INUSE);
+}
+
+// The flusher kernel thread.  Writes committed blocks to their
+// home locations, in block order, then writes a header without
+// them so their slots can be reused.  A block that has been
+// modified since its newest commit is left alone: its cached copy
+// is not the committed one.  Nor is a slot that has been freed
+// and reused, for this block or another, while we slept.
+static void
+flusher(void)
+{
+  struct logheader lh;
+  struct buf *b;
+  int slot[LOGSIZE], blockno[LOGSIZE];
+  uint seq[LOGSIZE];
+  int i, n;
+
+  for (;;) {
+    acquire(&log.lock);
+    while ((n = flushable(slot, blockno, seq)) == 0)
+      sleep(&log.flushwait, &log.lock);
+    release(&log.lock);
+
+    for (i = 0; i < n; i++) {
+      // Still pinned in the cache.  Holding the buffer keeps a
+      // transaction from modifying it while we look and write.
+      b = bread(log.dev, blockno[i]);
+      acquire(&log.lock);
+      if (!stillflushable(slot[i], blockno[i], seq[i])) {
+        // Modified by the open transaction, revoked by
+        // log_data(), or the slot was reused.
+        release(&log.lock);
+        brelse(b);
+        continue;
+      }
+      release(&log.lock);
+      bwrite(b);   // clears B_DIRTY
+      acquire(&log.lock);
+      if (stillflushable(slot[i], blockno[i], seq[i])) {
+        log.state[slot[i]] = SLOT_INSTALLED;
+        log.ninstall++;
+      }
+      release(&log.lock);
+      brelse(b);
+    }
+
+    acquiresleep(&log.headlock);
+    acquire(&log.lock);
+    make_head(&lh, 0);
+    release(&log.lock);
+    write_head(&lh);
+    acquire(&log.lock);
+    free_slots(&lh);
+    release(&log.lock);
+    releasesleep(&log.headlock);
   }
 }
 
 // Caller has modified b->data and is done with the buffer.
 // Record the block number and pin in the cache with B_DIRTY.
-// commit()/write_log() will do the disk write.
+// commit() will do the log write, and the flusher the write
+// to b's home location.
 //
 // log_write() replaces bwrite(); a typical use is:
 //   bp = bread(...)
@@ -215,20 +590,101 @@ log_write(struct buf *b)
 {
   int i;
 
-  if (log.lh.n >= LOGSIZE || log.lh.n >= log.size - 1)
-    panic("too big a transaction");
   if (log.outstanding < 1)
     panic("log_write outside of trans");
 
   acquire(&log.lock);
-  for (i = 0; i < log.lh.n; i++) {
-    if (log.lh.block[i] == b->blockno)   // log absorbtion
-      break;
+  for (i = 0; i < log.nslot; i++) {
+    if (log.state[i] == SLOT_PENDING && log.block[i] == b->blockno)
+      break;   // log absorbtion
+  }
+  if (i == log.nslot) {
+    for (i = 0; i < log.nslot; i++)
+      if (log.state[i] == SLOT_FREE)
+        break;
+    if (i == log.nslot || log.npending >= LOGSIZE)
+      panic("too big a transaction");
+    log.state[i] = SLOT_PENDING;
+    log.block[i] = b->blockno;
+    log.slotseq[i] = log.seq;
+    log.nused++;
+    log.npending++;
   }
-  log.lh.block[i] = b->blockno;
-  if (i == log.lh.n)
-    log.lh.n++;
   b->flags |= B_DIRTY; // prevent eviction
   release(&log.lock);
 }
 
+// Caller has modified b->data, a block of a regular file, and
+// is done with the buffer.  Start writing it to its home location
+// and release it; commit() waits for the write before the header,
+// so metadata pointing at the block only commits once it is on
+// disk.  A committed log copy from when the block held metadata
+// must never be installed over it: drop it from the log.
+void
+log_data(struct buf *b)
+{
+  int i, t;
+
+  if (log.outstanding < 1)
+    panic("log_data outside of trans");
+
+  acquire(&log.lock);
+  for (i = 0; i < log.nslot; i++) {
+    if (log.state[i] == SLOT_FREE || log.block[i] != b->blockno)
+      continue;
+    if (log.state[i] != SLOT_COMMITTED && log.state[i] != SLOT_INSTALLED)
+      panic("log_data: block in open transaction");
+    log.state[i] = SLOT_INSTALLED;  // free after the next header
+  }
+  log.ndatawrite++;
+  t = log.seq & 1;
+  for (i = 0; i < log.ndata[t]; i++)
+    if (log.data[t][i] == b->blockno)
+      break;
+  if (i < log.ndata[t] || log.ndata[t] < NDATA) {
+    log.data[t][i] = b->blockno;
+    if (i == log.ndata[t])
+      log.ndata[t]++;
+    release(&log.lock);
+    bawrite(b);
+  } else {
+    release(&log.lock);
+    bwrite(b);
+    brelse(b);
+  }
+}
+
+// Block b is being freed by the open transaction.  Until the
+// transaction commits, b still belongs to its old owner on disk:
+// then done_trans() hands it to bfreed().
+void
+log_free(uint b)
+{
+  if (b >= FSSIZE)
+    panic("log_free");
+  acquire(&log.lock);
+  log.freed[log.seq & 1][b/8] |= 1 << (b%8);
+  release(&log.lock);
+}
+
+// Make the next commit stop as if the machine crashed at point
+// (one of LOGCRASH_*), to test recovery; 0 cancels.
+void
+logcrash(int point)
+{
+  acquire(&log.lock);
+  log.crash = point;
+  release(&log.lock);
+}
+
+// Fill in the log statistics.
+void
+logstat(struct fsstat *st)
+{
+  acquire(&log.lock);
+  st->ncommit = log.ncommit;
+  st->nlogwrite = log.nlogwrite;
+  st->ninstall = log.ninstall;
+  st->ndatawrite = log.ndatawrite;
+  release(&log.lock);
+}
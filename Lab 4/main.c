@@ -28,12 +28,16 @@ main(void)
   uartinit();      // serial port
   pinit();         // process table
   tvinit();        // trap vectors
-  binit();         // buffer cache
+  slabinit();      // small object caches
   fileinit();      // file table
+  pipeinit();      // pipe buffers
+  shminit();       // shared memory segments
   ideinit();       // disk 
   startothers();   // start other processors
   kinit2(P2V(4*1024*1024), P2V(PHYSTOP)); // must come after startothers()
+  binit();         // buffer cache, sized from free memory
   userinit();      // first user process
+  kzeroinit();     // background page zeroing
   mpmain();        // finish this processor's setup
 }
 
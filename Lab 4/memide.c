@@ -57,4 +57,6 @@ iderw(struct buf *b)
   } else
     memmove(b->data, p, BSIZE);
   b->flags |= B_VALID;
+  if(b->flags & B_ASYNC)
+    bdone(b);
 }
@@ -0,0 +1,43 @@
+// Print memory use and page-fault counts for processes.
+// With no arguments, print every process; since pids are handed
+// out in increasing order, they are all at or below our own.
+// Sizes are in KB; "rss" is private resident memory, "zero" pages
+// map the shared zero page and "ptab" is page table memory.
+//
+// usage: memstat [pid...]
+
+#include "types.h"
+#include "memstat.h"
+#include "user.h"
+
+static int
+show(int pid)
+{
+  struct memstat st;
+
+  if(memstat(pid, &st) < 0)
+    return -1;
+  printf(1, "%d\t%s\t%d\t%d\t%d\t%d\t%d\t%d\t%d\t%d\n", pid, st.name,
+         st.sz/1024, st.resident*4, st.zeromapped*4, st.swapped*4,
+         st.pgtables*4, st.nminfault, st.nmajfault, st.nfault);
+  return 0;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int i, pid;
+
+  printf(1, "pid\tname\tsize\trss\tzero\tswap\tptab\tminflt\tmajflt\theapflt\n");
+  if(argc > 1){
+    for(i = 1; i < argc; i++){
+      pid = atoi(argv[i]);
+      if(pid <= 0 || show(pid) < 0)
+        printf(2, "memstat: no process %s\n", argv[i]);
+    }
+    exit();
+  }
+  for(pid = 1; pid <= getpid(); pid++)
+    show(pid);
+  exit();
+}
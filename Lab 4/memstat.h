@@ -0,0 +1,17 @@
+// Per-process memory statistics,
+// filled in by the memstat() system call.
+// Page counts cover mmap() regions as well as sz.
+struct memstat {
+  char name[16];    // process name
+  uint sz;          // size of process memory (bytes)
+  uint resident;    // pages backed by private memory
+  uint zeromapped;  // pages mapping the shared zero page
+  uint swapped;     // pages paged out to swap
+  uint superpages;  // 4 MB superpages (their pages count as resident)
+  uint pgtables;    // page table pages, and the page directory
+  uint nminfault;   // page faults resolved without disk I/O
+  uint nmajfault;   // page faults that read from swap or a file
+  uint nfault;      // lazy heap page faults taken
+  uint nprefault;   // pages mapped ahead of a fault (fault-around)
+  uint nexecfault;  // pages read in from the executable on demand
+};
@@ -30,7 +30,8 @@ int fsfd;
 struct superblock sb;
 char zeroes[BSIZE];
 uint freeinode = 1;
-uint freeblock;
+uint freeblock;  // must stay below FSSIZE: the swap area follows
+int extents;  // -e: map files by extents
 
 
 void balloc(int);
@@ -76,8 +77,13 @@ main(int argc, char *argv[])
 
   static_assert(sizeof(int) == 4, "Integers must be 4 bytes!");
 
+  if(argc > 1 && strcmp(argv[1], "-e") == 0){
+    extents = 1;
+    argc--;
+    argv++;
+  }
   if(argc < 2){
-    fprintf(stderr, "Usage: mkfs fs.img files...\n");
+    fprintf(stderr, "Usage: mkfs [-e] fs.img files...\n");
     exit(1);
   }
 
@@ -101,6 +107,9 @@ main(int argc, char *argv[])
   sb.logstart = xint(2);
   sb.inodestart = xint(2+nlog);
   sb.bmapstart = xint(2+nlog+ninodeblocks);
+  sb.swapstart = xint(FSSIZE);
+  sb.nswap = xint(SWAPSIZE);
+  sb.flags = xint(extents ? FS_EXTENTS : 0);
 
   printf("nmeta %d (boot, super, log blocks %u inode blocks %u, bitmap blocks %u) blocks %d total %d\n",
          nmeta, nlog, ninodeblocks, nbitmap, nblocks, FSSIZE);
@@ -109,6 +118,8 @@ main(int argc, char *argv[])
 
   for(i = 0; i < FSSIZE; i++)
     wsect(i, zeroes);
+  // Extend the image over the swap area; no need to zero it.
+  wsect(FSSIZE + SWAPSIZE - 1, zeroes);
 
   memset(buf, 0, sizeof(buf));
   memmove(buf, &sb, sizeof(sb));
@@ -158,7 +169,7 @@ main(int argc, char *argv[])
   // fix size of root inode dir
   rinode(rootino, &din);
   off = xint(din.size);
-  off = ((off/BSIZE) + 1) * BSIZE;
+  off = ((off + BSIZE - 1) / BSIZE) * BSIZE;
   din.size = xint(off);
   winode(rootino, &din);
 
@@ -252,11 +263,40 @@ balloc(int used)
 
 #define min(a, b) ((a) < (b) ? (a) : (b))
 
+// Return the block holding file block fbn of an extent-mapped
+// inode, allocating the next free block if fbn is just past the
+// end.  Files are written one after another, so each takes a run
+// of blocks or, like the root directory, a few.
+uint
+xbmap(struct dinode *din, uint fbn)
+{
+  struct extent *x = (struct extent*)din->addrs;
+  uint base = 0;
+  int i;
+
+  for(i = 0; i < NIEXTENT && xint(x[i].len) != 0; i++){
+    if(fbn < base + xint(x[i].len))
+      return xint(x[i].start) + fbn - base;
+    base += xint(x[i].len);
+  }
+  assert(fbn == base);
+  if(i > 0 && xint(x[i-1].start) + xint(x[i-1].len) == freeblock){
+    x[i-1].len = xint(xint(x[i-1].len) + 1);
+    assert(freeblock < FSSIZE);
+    return freeblock++;
+  }
+  assert(i < NIEXTENT);
+  x[i].start = xint(freeblock);
+  x[i].len = xint(1);
+  assert(freeblock < FSSIZE);
+  return freeblock++;
+}
+
 void
 iappend(uint inum, void *xp, int n)
 {
   char *p = (char*)xp;
-  uint fbn, off, n1;
+  uint fbn, dbn, off, n1;
   struct dinode din;
   char buf[BSIZE];
   uint indirect[NINDIRECT];
@@ -268,21 +308,47 @@ iappend(uint inum, void *xp, int n)
   while(n > 0){
     fbn = off / BSIZE;
     assert(fbn < MAXFILE);
-    if(fbn < NDIRECT){
+    if(extents){
+      x = xbmap(&din, fbn);
+    } else if(fbn < NDIRECT){
       if(xint(din.addrs[fbn]) == 0){
+        assert(freeblock < FSSIZE);
         din.addrs[fbn] = xint(freeblock++);
       }
       x = xint(din.addrs[fbn]);
-    } else {
+    } else if(fbn < NDIRECT + NINDIRECT){
       if(xint(din.addrs[NDIRECT]) == 0){
+        assert(freeblock < FSSIZE);
         din.addrs[NDIRECT] = xint(freeblock++);
       }
       rsect(xint(din.addrs[NDIRECT]), (char*)indirect);
       if(indirect[fbn - NDIRECT] == 0){
+        assert(freeblock < FSSIZE);
         indirect[fbn - NDIRECT] = xint(freeblock++);
         wsect(xint(din.addrs[NDIRECT]), (char*)indirect);
       }
       x = xint(indirect[fbn-NDIRECT]);
+    } else {
+      // double-indirect: an indirect block of indirect blocks
+      dbn = fbn - NDIRECT - NINDIRECT;
+      if(xint(din.addrs[NDIRECT+1]) == 0){
+        assert(freeblock < FSSIZE);
+        din.addrs[NDIRECT+1] = xint(freeblock++);
+      }
+      rsect(xint(din.addrs[NDIRECT+1]), (char*)indirect);
+      if(indirect[dbn / NINDIRECT] == 0){
+        assert(freeblock < FSSIZE);
+        indirect[dbn / NINDIRECT] = xint(freeblock++);
+        wsect(xint(din.addrs[NDIRECT+1]), (char*)indirect);
+      }
+      x = xint(indirect[dbn / NINDIRECT]);
+      rsect(x, (char*)indirect);
+      if(indirect[dbn % NINDIRECT] == 0){
+        assert(freeblock < FSSIZE);
+        indirect[dbn % NINDIRECT] = xint(freeblock++);
+        wsect(x, (char*)indirect);
+      }
+      x = xint(indirect[dbn % NINDIRECT]);
     }
     n1 = min(n, (fbn + 1) * BSIZE - off);
     rsect(x, buf);
@@ -0,0 +1,11 @@
+// mmap() protection and flags, and madvise() advice
+#define PROT_READ     0x1
+#define PROT_WRITE    0x2
+
+#define MAP_SHARED    0x01   // writes go back to the file
+#define MAP_PRIVATE   0x02   // writes stay in this process
+#define MAP_ANONYMOUS 0x20   // zero-filled memory, no file
+
+// madvise() advice
+#define MADV_NORMAL   0      // no special treatment
+#define MADV_DONTNEED 4      // free the pages; they fault in afresh
@@ -0,0 +1,461 @@
+// Memory-mapped files and anonymous memory.
+//
+// Each process has a small table of VMAs, regions of its address
+// space above the heap that mmap() has set up.  They are placed
+// top-down below KERNBASE, and sbrk() may not grow the heap into
+// them.  Nothing is mapped at mmap() time: mmapfault() allocates
+// each page the first time it is touched, reading file-backed pages
+// through the buffer cache with readi().  Dirty pages of a shared
+// file mapping are written back with writei() when the region is
+// unmapped, or when the process exits or execs.
+//
+// fork() copies the VMA table, and the child gets its own copy of
+// each page of a private or anonymous mapping that the parent has
+// touched.  Pages of a shared file mapping are not copied; the
+// child faults them in afresh from the file.  So a MAP_SHARED
+// mapping is only shared with the file, and anonymous memory is
+// always private.
+//
+// Mapped pages are never paged out to swap.
+//
+// A region may instead map a shared memory segment (v->shm; see
+// shm.c).  Its pages belong to the segment, not the process: they
+// are faulted in from the segment and never freed here.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "x86.h"
+#include "proc.h"
+#include "fs.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "file.h"
+#include "stat.h"
+#include "mman.h"
+
+pte_t *walkpgdir(pde_t *pgdir, const void *va, int alloc);
+int mappages(pde_t *pgdir, void *va, uint size, uint pa, int perm);
+
+// Return the VMA of p containing va, or 0.
+static struct vma*
+findvma(struct proc *p, uint va)
+{
+  struct vma *v;
+
+  for(v = p->vma; v < &p->vma[NVMA]; v++)
+    if(v->start <= va && va < v->end)
+      return v;
+  return 0;
+}
+
+// Lowest address used by p's mappings; the heap must stay below it.
+uint
+mmapbase(struct proc *p)
+{
+  struct vma *v;
+  uint base;
+
+  base = KERNBASE;
+  for(v = p->vma; v < &p->vma[NVMA]; v++)
+    if(v->start < v->end && v->start < base)
+      base = v->start;
+  return base;
+}
+
+// Find the highest free range of len bytes below KERNBASE
+// and above the heap.  Returns 0 if there is none.
+static uint
+findfree(struct proc *p, uint len)
+{
+  struct vma *v;
+  uint a;
+
+  a = KERNBASE - len;
+  for(;;){
+    if(a < PGROUNDUP(p->sz) || a > KERNBASE - len)
+      return 0;
+    for(v = p->vma; v < &p->vma[NVMA]; v++)
+      if(v->start < v->end && a < v->end && v->start < a + len)
+        break;
+    if(v == &p->vma[NVMA])
+      return a;
+    a = v->start - len;  // try just below the overlapping region
+  }
+}
+
+// Take an unused VMA of p and place it at a free range of len
+// bytes.  Returns 0 if there is no room.
+static struct vma*
+vmaalloc(struct proc *p, uint len)
+{
+  struct vma *v;
+  uint a;
+
+  len = PGROUNDUP(len);
+  for(v = p->vma; v < &p->vma[NVMA]; v++)
+    if(v->start == v->end)
+      break;
+  if(v == &p->vma[NVMA] || (a = findfree(p, len)) == 0)
+    return 0;
+  memset(v, 0, sizeof(*v));
+  v->start = a;
+  v->end = a + len;
+  return v;
+}
+
+// Create a mapping of len bytes.  f is 0 for anonymous memory.
+// Returns the address, or -1.
+int
+mmap(uint len, int prot, int flags, struct file *f, uint off)
+{
+  struct proc *p = myproc();
+  struct vma *v;
+  int type;
+
+  if(len == 0 || len >= KERNBASE || off % PGSIZE != 0)
+    return -1;
+  if(!(prot & PROT_READ))
+    return -1;
+  if((flags & (MAP_SHARED|MAP_PRIVATE)) == 0 ||
+     (flags & (MAP_SHARED|MAP_PRIVATE)) == (MAP_SHARED|MAP_PRIVATE))
+    return -1;
+  if(flags & MAP_ANONYMOUS)
+    f = 0;
+  else {
+    if(f == 0 || f->type != FD_INODE || !f->readable)
+      return -1;
+    ilock(f->ip);
+    type = f->ip->type;
+    iunlock(f->ip);
+    if(type == T_DEV)
+      return -1;
+    if((flags & MAP_SHARED) && (prot & PROT_WRITE) && !f->writable)
+      return -1;
+  }
+
+  if((v = vmaalloc(p, len)) == 0)
+    return -1;
+  v->prot = prot;
+  v->flags = flags;
+  v->f = f ? filedup(f) : 0;
+  v->off = off;
+  return v->start;
+}
+
+// Map shared memory segment s, of len bytes, read-write.
+// The caller passes on its attachment to the region.
+// Returns the address, or -1.
+int
+shmmap(struct shmseg *s, uint len)
+{
+  struct vma *v;
+
+  if((v = vmaalloc(myproc(), len)) == 0)
+    return -1;
+  v->prot = PROT_READ|PROT_WRITE;
+  v->flags = MAP_SHARED;
+  v->shm = s;
+  return v->start;
+}
+
+// Unmap the shared memory region that starts at addr.
+int
+shmunmap(uint addr)
+{
+  struct vma *v;
+
+  if((v = findvma(myproc(), addr)) == 0 || v->shm == 0 || v->start != addr)
+    return -1;
+  return munmap(v->start, v->end - v->start);
+}
+
+// Write page a of shared file mapping v, at kernel address mem,
+// back to the file.  Only the part inside the file is written.
+static void
+writeback(struct vma *v, uint a, char *mem)
+{
+  struct inode *ip = v->f->ip;
+  int max = (MAXOPDATA-1) * BSIZE;
+  uint off, i, n;
+
+  off = v->off + (a - v->start);
+  for(i = 0; i < PGSIZE; i += n){
+    // a few blocks per transaction, as in filewrite().
+    begin_op();
+    ilock(ip);
+    n = 0;
+    if(off + i < ip->size){
+      n = ip->size - (off + i);
+      if(n > PGSIZE - i)
+        n = PGSIZE - i;
+      if(n > max)
+        n = max;
+      writei(ip, mem + i, off + i, n);
+    }
+    iunlock(ip);
+    end_op();
+    if(n == 0)
+      break;
+  }
+}
+
+// Unmap the pages of v in [start, end), writing back dirty pages
+// of a shared file mapping.  If free is zero, the pages are left
+// mapped for freevm() to release.
+static void
+unmappages(struct proc *p, struct vma *v, uint start, uint end, int free)
+{
+  pte_t *pte;
+  uint a;
+  char *mem;
+
+  for(a = start; a < end; a += PGSIZE){
+    if((pte = walkpgdir(p->pgdir, (char*)a, 0)) == 0){
+      a = PGADDR(PDX(a) + 1, 0, 0) - PGSIZE;
+      continue;
+    }
+    if(!(*pte & PTE_P))
+      continue;
+    if(v->shm){
+      *pte = 0;  // the segment's page, not ours to free
+      continue;
+    }
+    mem = P2V(PTE_ADDR(*pte));
+    if(v->f && (v->flags & MAP_SHARED) && (v->prot & PROT_WRITE) &&
+       (*pte & PTE_D))
+      writeback(v, a, mem);
+    if(free){
+      kfree(mem);
+      *pte = 0;
+    }
+  }
+}
+
+// Remove the mappings in [addr, addr+len).  A region may be
+// trimmed at either end or split in two.
+int
+munmap(uint addr, uint len)
+{
+  struct proc *p = myproc();
+  struct vma *v, *nv;
+  uint end, lo, hi;
+
+  if(addr % PGSIZE != 0 || len == 0 || addr + len < addr)
+    return -1;
+  end = PGROUNDUP(addr + len);
+  for(v = p->vma; v < &p->vma[NVMA]; v++){
+    if(v->start == v->end || end <= v->start || v->end <= addr)
+      continue;
+    lo = addr > v->start ? addr : v->start;
+    hi = end < v->end ? end : v->end;
+    if(lo > v->start && hi < v->end){
+      // Punch a hole: the upper part becomes a new region.
+      for(nv = p->vma; nv < &p->vma[NVMA]; nv++)
+        if(nv->start == nv->end)
+          break;
+      if(nv == &p->vma[NVMA])
+        return -1;
+      *nv = *v;
+      nv->start = hi;
+      nv->off = v->off + (hi - v->start);
+      if(nv->f)
+        filedup(nv->f);
+      if(nv->shm)
+        shmdup(nv->shm);
+      v->end = hi;
+    }
+    unmappages(p, v, lo, hi, 1);
+    if(lo == v->start){
+      v->off += hi - lo;
+      v->start = hi;
+    } else
+      v->end = lo;
+    if(v->start == v->end){
+      if(v->f)
+        fileclose(v->f);
+      if(v->shm)
+        shmput(v->shm);
+      memset(v, 0, sizeof(*v));
+    }
+  }
+  lcr3(V2P(p->pgdir));  // flush the TLB
+  return 0;
+}
+
+// Drop all of p's mappings, writing back dirty shared pages.
+// Called from exit() and exec(); the pages themselves are
+// freed along with the page table, except for shared memory
+// segments' pages, which are unmapped here.
+void
+munmapall(struct proc *p)
+{
+  struct vma *v;
+
+  for(v = p->vma; v < &p->vma[NVMA]; v++){
+    if(v->start == v->end)
+      continue;
+    unmappages(p, v, v->start, v->end, 0);
+    if(v->f)
+      fileclose(v->f);
+    if(v->shm)
+      shmput(v->shm);
+    memset(v, 0, sizeof(*v));
+  }
+}
+
+// Copy the pages of p's mapping v that are present into np's
+// page table, as copyuvm() does for the heap.
+static int
+copypages(struct proc *np, struct proc *p, struct vma *v)
+{
+  pte_t *pte;
+  uint a;
+  char *mem;
+
+  for(a = v->start; a < v->end; a += PGSIZE){
+    if((pte = walkpgdir(p->pgdir, (char*)a, 0)) == 0){
+      a = PGADDR(PDX(a) + 1, 0, 0) - PGSIZE;
+      continue;
+    }
+    if(!(*pte & PTE_P))
+      continue;
+    if((mem = kallocswap()) == 0)
+      return -1;
+    memmove(mem, P2V(PTE_ADDR(*pte)), PGSIZE);
+    if(mappages(np->pgdir, (char*)a, PGSIZE, V2P(mem),
+                PTE_FLAGS(*pte) & (PTE_W|PTE_U)) < 0){
+      kfree(mem);
+      return -1;
+    }
+  }
+  return 0;
+}
+
+// Give child np copies of p's mappings, and of the pages of its
+// private and anonymous ones.  On failure, returns -1 having
+// dropped the mappings; the caller frees np's page table.
+int
+mmapfork(struct proc *np, struct proc *p)
+{
+  struct vma *v;
+  int i;
+
+  for(i = 0; i < NVMA; i++){
+    np->vma[i] = p->vma[i];
+    if(np->vma[i].f)
+      filedup(np->vma[i].f);
+    if(np->vma[i].shm)
+      shmdup(np->vma[i].shm);
+  }
+  for(v = p->vma; v < &p->vma[NVMA]; v++){
+    if(v->start == v->end || v->shm || (v->f && (v->flags & MAP_SHARED)))
+      continue;
+    if(copypages(np, p, v) < 0){
+      munmapall(np);
+      return -1;
+    }
+  }
+  return 0;
+}
+
+// Handle a page fault at va in one of p's mappings.
+// Returns 0 if the fault was resolved, -1 if va is not mapped
+// or the access is not allowed.
+int
+mmapfault(struct proc *p, uint va, int err)
+{
+  struct vma *v;
+  pte_t *pte;
+  char *mem;
+  uint a;
+  int n;
+
+  if((v = findvma(p, va)) == 0)
+    return -1;
+  a = PGROUNDDOWN(va);
+  pte = walkpgdir(p->pgdir, (char*)a, 0);
+
+  if((err & FEC_WR) && !(v->prot & PROT_WRITE)){
+    if(err & FEC_U)
+      return -1;
+    // The kernel is storing into a read-only mapping on the
+    // process's behalf, e.g. read() into it.  Let the store land
+    // in a private copy that is never written back, and kill the
+    // process on its way back to user space.
+    if((mem = kalloc()) == 0)
+      return -1;
+    if(pte && (*pte & PTE_P)){
+      memmove(mem, P2V(PTE_ADDR(*pte)), PGSIZE);
+      kfree(P2V(PTE_ADDR(*pte)));
+      *pte = V2P(mem) | PTE_P | PTE_W | PTE_U;
+      lcr3(V2P(p->pgdir));
+    } else {
+      memset(mem, 0, PGSIZE);
+      if(mappages(p->pgdir, (char*)a, PGSIZE, V2P(mem), PTE_W|PTE_U) < 0){
+        kfree(mem);
+        return -1;
+      }
+    }
+    p->killed = 1;
+    return 0;
+  }
+  if(pte && (*pte & PTE_P))
+    return -1;
+
+  if(v->shm){
+    // Shared memory regions are always read-write, so the
+    // private-copy case above never applies to them.
+    if((mem = shmpage(v->shm, (v->off + (a - v->start)) / PGSIZE)) == 0 ||
+       mappages(p->pgdir, (char*)a, PGSIZE, V2P(mem), PTE_W|PTE_U) < 0){
+      cprintf("mmapfault: out of memory\n");
+      return -1;
+    }
+    return 0;
+  }
+
+  if((mem = v->f ? kallocswap() : kallocswap_zeroed()) == 0){
+    cprintf("mmapfault: out of memory\n");
+    return -1;
+  }
+  if(v->f){
+    ilock(v->f->ip);
+    n = readi(v->f->ip, mem, v->off + (a - v->start), PGSIZE);
+    iunlock(v->f->ip);
+    if(n < 0)
+      n = 0;
+    memset(mem + n, 0, PGSIZE - n);
+    p->nmajfault++;
+  }
+  if(mappages(p->pgdir, (char*)a, PGSIZE, V2P(mem),
+              (v->prot & PROT_WRITE) ? PTE_W|PTE_U : PTE_U) < 0){
+    cprintf("mmapfault: out of memory (2)\n");
+    kfree(mem);
+    return -1;
+  }
+  return 0;
+}
+
+// Check that [va, va+n) lies inside one of p's mappings and fault
+// in its missing pages, as uvmprefault() does below p->sz.
+// Returns -1 if the range is not mapped.
+int
+mmapprefault(struct proc *p, uint va, uint n)
+{
+  struct vma *v;
+  pte_t *pte;
+  uint a;
+
+  if((v = findvma(p, va)) == 0 || va + n < va || va + n > v->end)
+    return -1;
+  for(a = PGROUNDDOWN(va); a < va + n; a += PGSIZE){
+    if((pte = walkpgdir(p->pgdir, (char*)a, 0)) != 0 && (*pte & PTE_P))
+      continue;
+    if(mmapfault(p, a, 0) < 0)
+      return -1;
+    p->npgfault++;
+  }
+  return 0;
+}
@@ -0,0 +1,89 @@
+// Scan a file with read() in 512-byte chunks and then through
+// mmap(), and report the ticks each takes.  With no argument,
+// a scratch file is created first.
+//
+// usage: mmapbench [file]
+
+#include "types.h"
+#include "stat.h"
+#include "fcntl.h"
+#include "mman.h"
+#include "user.h"
+
+#define NPASS  20
+#define FILESZ (64*1024)
+
+char buf[512];
+
+static void
+mkfile(char *name)
+{
+  int fd, i;
+
+  if((fd = open(name, O_CREATE|O_RDWR)) < 0){
+    printf(2, "mmapbench: cannot create %s\n", name);
+    exit();
+  }
+  for(i = 0; i < sizeof(buf); i++)
+    buf[i] = i;
+  for(i = 0; i < FILESZ; i += sizeof(buf))
+    if(write(fd, buf, sizeof(buf)) != sizeof(buf)){
+      printf(2, "mmapbench: write failed\n");
+      exit();
+    }
+  close(fd);
+}
+
+int
+main(int argc, char *argv[])
+{
+  char *name, *p;
+  struct stat st;
+  uint rsum, msum;
+  int fd, i, j, n, t;
+
+  name = "mmapbench.dat";
+  if(argc > 1)
+    name = argv[1];
+  else
+    mkfile(name);
+  if((fd = open(name, O_RDONLY)) < 0 || fstat(fd, &st) < 0){
+    printf(2, "mmapbench: cannot open %s\n", name);
+    exit();
+  }
+  close(fd);
+
+  rsum = 0;
+  t = uptime();
+  for(i = 0; i < NPASS; i++){
+    fd = open(name, O_RDONLY);
+    while((n = read(fd, buf, sizeof(buf))) > 0)
+      for(j = 0; j < n; j++)
+        rsum += (uchar)buf[j];
+    close(fd);
+  }
+  printf(1, "read: %d passes over %d bytes, %d ticks\n",
+         NPASS, st.size, uptime() - t);
+
+  msum = 0;
+  t = uptime();
+  for(i = 0; i < NPASS; i++){
+    fd = open(name, O_RDONLY);
+    if((p = mmap(0, st.size, PROT_READ, MAP_SHARED, fd, 0)) == (char*)-1){
+      printf(2, "mmapbench: mmap failed\n");
+      exit();
+    }
+    close(fd);
+    for(j = 0; j < st.size; j++)
+      msum += (uchar)p[j];
+    munmap(p, st.size);
+  }
+  printf(1, "mmap: %d passes over %d bytes, %d ticks\n",
+         NPASS, st.size, uptime() - t);
+
+  if(rsum != msum)
+    printf(2, "mmapbench: checksums differ\n");
+  if(argc <= 1)
+    unlink(name);
+  exit();
+}
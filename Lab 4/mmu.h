@@ -10,6 +10,7 @@
 #define CR0_PG          0x80000000      // Paging
 
 #define CR4_PSE         0x00000010      // Page size extension
+#define CR4_PGE         0x00000080      // Page global enable
 
 // various segment selectors.
 #define SEG_KCODE 1  // kernel code
@@ -83,18 +84,30 @@ struct segdesc {
 #define NPDENTRIES      1024    // # directory entries per page directory
 #define NPTENTRIES      1024    // # PTEs per page table
 #define PGSIZE          4096    // bytes mapped by a page
+#define SPGSIZE         (PGSIZE*NPTENTRIES)  // bytes mapped by a 4 MB superpage
+#define SPGORDER        10      // log2(pages per superpage)
 
 #define PTXSHIFT        12      // offset of PTX in a linear address
 #define PDXSHIFT        22      // offset of PDX in a linear address
 
 #define PGROUNDUP(sz)  (((sz)+PGSIZE-1) & ~(PGSIZE-1))
 #define PGROUNDDOWN(a) (((a)) & ~(PGSIZE-1))
+#define SPGROUNDDOWN(a) (((a)) & ~(SPGSIZE-1))
 
 // Page table/directory entry flags.
 #define PTE_P           0x001   // Present
 #define PTE_W           0x002   // Writeable
 #define PTE_U           0x004   // User
+#define PTE_A           0x020   // Accessed
+#define PTE_D           0x040   // Dirty
 #define PTE_PS          0x080   // Page Size
+#define PTE_G           0x100   // Global: kept in the TLB across %cr3 loads
+#define PTE_SWAP        0x200   // Not present: paged out (software bit)
+
+// Page fault error code bits (tf->err)
+#define FEC_PR          0x1     // Fault on a present page (protection)
+#define FEC_WR          0x2     // Fault caused by a write
+#define FEC_U           0x4     // Fault from user mode
 
 // Address in page table or page directory entry
 #define PTE_ADDR(pte)   ((uint)(pte) & ~0xFFF)
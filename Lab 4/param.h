@@ -3,12 +3,35 @@
 #define NCPU          8  // maximum number of CPUs
 #define NOFILE       16  // open files per process
 #define NFILE       100  // open files per system
-#define NINODE       50  // maximum number of active i-nodes
+#define NINODE       50  // min size of i-node cache
+#define NINODEMAX  2048  // max size of i-node cache
+#define INODEMEM    256  // i-node cache may use 1/INODEMEM of memory
+#define NINODEHASH  127  // i-node cache hash buckets
 #define NDEV         10  // maximum major device number
 #define ROOTDEV       1  // device number of file system root disk
 #define MAXARG       32  // max exec arguments
+#define MAXPATH     128  // max path name length, with the nul
 #define MAXOPBLOCKS  10  // max # of blocks any FS op writes
+#define MAXOPDATA    64  // max # of file blocks a write op sends home
 #define LOGSIZE      (MAXOPBLOCKS*3)  // max data blocks in on-disk log
-#define NBUF         (MAXOPBLOCKS*3)  // size of disk block cache
-#define FSSIZE       1000  // size of file system in blocks
+#define NBUF         (LOGSIZE*3)  // min size of disk block cache
+#define NBUFMAX      4096  // max size of disk block cache
+#define NAWRITE      (NBUF/4)  // max asynchronous disk writes in flight
+#define BUFMEM       64  // disk block cache may use 1/BUFMEM of memory
+#define NBUFHASH     251  // buffer cache hash buckets
+#define FSSIZE       20000  // size of file system in blocks
+#define SWAPSIZE     524288  // size of swap area after the file system, in blocks
+#define SWAPLOW      64  // kswapd pages out below this many free pages
+#define SWAPHIGH     128  // ... until this many are free again
+#define MAXORDER     10  // largest physical block is 2^MAXORDER pages
+#define ZEROPOOL     256  // free pages kzerod keeps zeroed ahead of time
+#define FAULTAROUND  16  // default max pages mapped per lazy heap fault
+#define MAXFAULTAROUND 256  // upper limit for faultaround()
+#define READAHEAD     32  // default max blocks read ahead of a sequential reader
+#define MAXREADAHEAD 128  // upper limit for readahead()
+#define NSEG          4  // max loadable segments per executable
+#define NVMA          8  // mmap() regions per process
+#define NSHM         16  // shared memory segments
+#define SHMMAXPAGES 256  // max pages in a shared memory segment
 
+#define NCACHE       16  // maximum number of slab caches
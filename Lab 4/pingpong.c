@@ -0,0 +1,59 @@
+// Bounce a byte between two processes over a pair of pipes and
+// report the ticks taken.  Each round trip is two context
+// switches on a single CPU, so this mostly measures switch cost.
+//
+// usage: pingpong [rounds]
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+
+int
+main(int argc, char *argv[])
+{
+  int ping[2], pong[2];
+  int i, n, pid, t;
+  char c;
+
+  n = 10000;
+  if(argc > 1)
+    n = atoi(argv[1]);
+  if(n <= 0){
+    printf(2, "usage: pingpong [rounds]\n");
+    exit();
+  }
+  if(pipe(ping) < 0 || pipe(pong) < 0){
+    printf(2, "pingpong: pipe failed\n");
+    exit();
+  }
+
+  pid = fork();
+  if(pid < 0){
+    printf(2, "pingpong: fork failed\n");
+    exit();
+  }
+  if(pid == 0){
+    close(ping[1]);
+    close(pong[0]);
+    while(read(ping[0], &c, 1) == 1)
+      write(pong[1], &c, 1);
+    exit();
+  }
+  close(ping[0]);
+  close(pong[1]);
+
+  t = uptime();
+  for(i = 0; i < n; i++){
+    c = i;
+    if(write(ping[1], &c, 1) != 1 || read(pong[0], &c, 1) != 1){
+      printf(2, "pingpong: lost the ball after %d rounds\n", i);
+      break;
+    }
+  }
+  t = uptime() - t;
+  close(ping[1]);
+  wait();
+
+  printf(1, "%d round trips, %d ticks\n", i, t);
+  exit();
+}
@@ -6,6 +6,7 @@
 #include "x86.h"
 #include "proc.h"
 #include "spinlock.h"
+#include "memstat.h"
 
 struct {
   struct spinlock lock;
@@ -88,6 +89,21 @@ allocproc(void)
 found:
   p->state = EMBRYO;
   p->pid = nextpid++;
+  p->lastfault = 0;
+  p->fawin = 1;
+  p->famax = FAULTAROUND;
+  p->superpages = 1;
+  p->ramax = READAHEAD;
+  p->tlbcpu = 0;
+  p->insyscall = 0;
+  p->nfault = 0;
+  p->nprefault = 0;
+  p->nexecfault = 0;
+  p->npgfault = 0;
+  p->nmajfault = 0;
+  p->exe = 0;
+  p->nseg = 0;
+  memset(p->vma, 0, sizeof(p->vma));
 
   release(&ptable.lock);
 
@@ -153,6 +169,41 @@ userinit(void)
   release(&ptable.lock);
 }
 
+// A kernel thread's first scheduling swtches here instead of
+// to forkret.  fn is the argument kthread() placed above the
+// return address slot.
+static void
+kthreadstart(void (*fn)(void))
+{
+  // Still holding ptable.lock from scheduler.
+  release(&ptable.lock);
+  fn();
+  panic("kthread returned");
+}
+
+// Start a kernel thread running fn, which must never return.
+// It has a kernel-only page table and no user memory.
+struct proc*
+kthread(char *name, void (*fn)(void))
+{
+  struct proc *p;
+
+  if((p = allocproc()) == 0)
+    panic("kthread");
+  if((p->pgdir = setupkvm()) == 0)
+    panic("kthread: out of memory?");
+  p->sz = 0;
+  p->parent = initproc;
+  safestrcpy(p->name, name, sizeof(p->name));
+  p->context->eip = (uint)kthreadstart;
+  ((uint*)(p->context + 1))[1] = (uint)fn;
+
+  acquire(&ptable.lock);
+  p->state = RUNNABLE;
+  release(&ptable.lock);
+  return p;
+}
+
 // Grow current process's memory by n bytes.
 // Return 0 on success, -1 on failure.
 int
@@ -196,7 +247,18 @@ fork(void)
     np->state = UNUSED;
     return -1;
   }
+  if(mmapfork(np, curproc) < 0){
+    freevm(np->pgdir);
+    np->pgdir = 0;
+    kfree(np->kstack);
+    np->kstack = 0;
+    np->state = UNUSED;
+    return -1;
+  }
   np->sz = curproc->sz;
+  np->famax = curproc->famax;
+  np->superpages = curproc->superpages;
+  np->ramax = curproc->ramax;
   np->parent = curproc;
   *np->tf = *curproc->tf;
 
@@ -207,6 +269,11 @@ fork(void)
     if(curproc->ofile[i])
       np->ofile[i] = filedup(curproc->ofile[i]);
   np->cwd = idup(curproc->cwd);
+  if(curproc->exe)
+    np->exe = idup(curproc->exe);
+  np->nseg = curproc->nseg;
+  for(i = 0; i < curproc->nseg; i++)
+    np->seg[i] = curproc->seg[i];
 
   safestrcpy(np->name, curproc->name, sizeof(curproc->name));
 
@@ -242,10 +309,17 @@ exit(void)
     }
   }
 
+  munmapall(curproc);
+  shmexit(curproc->pid);
+
   begin_op();
   iput(curproc->cwd);
+  if(curproc->exe)
+    iput(curproc->exe);
   end_op();
   curproc->cwd = 0;
+  curproc->exe = 0;
+  curproc->nseg = 0;
 
   acquire(&ptable.lock);
 
@@ -332,6 +406,7 @@ scheduler(void)
 
     // Loop over process table looking for process to run.
     acquire(&ptable.lock);
+    idleuvm();
     for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
       if(p->state != RUNNABLE)
         continue;
@@ -340,11 +415,15 @@ scheduler(void)
       // to release ptable.lock and then reacquire it
       // before jumping back to us.
       c->proc = p;
-      switchuvm(p);
+      resumeuvm(p);
       p->state = RUNNING;
 
       swtch(&(c->scheduler), p->context);
-      switchkvm();
+      // Keep p's page table loaded: if p, or nothing, runs next,
+      // there is no %cr3 load to pay.  But let go of an exiting
+      // process's, so that wait() can free it at once.
+      if(p->state == ZOMBIE)
+        switchkvm();
 
       // Process is done running for now.
       // It should have changed its p->state before coming back.
@@ -407,6 +486,8 @@ forkret(void)
     first = 0;
     iinit(ROOTDEV);
     initlog(ROOTDEV);
+    ballocinit(ROOTDEV);
+    swapinit(ROOTDEV);
   }
 
   // Return to "caller", actually trapret (see allocproc).
@@ -496,6 +577,75 @@ kill(int pid)
   return -1;
 }
 
+// Copy out memory statistics for process pid,
+// or for the calling process if pid is 0.
+int
+procmemstat(int pid, struct memstat *st)
+{
+  struct proc *p;
+
+  if(pid == 0)
+    pid = myproc()->pid;
+  acquire(&ptable.lock);
+  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
+    if(p->state != UNUSED && p->state != EMBRYO && p->pid == pid){
+      safestrcpy(st->name, p->name, sizeof(st->name));
+      st->sz = p->sz;
+      uvmcount(p->pgdir, st);
+      st->nminfault = p->npgfault - p->nmajfault;
+      st->nmajfault = p->nmajfault;
+      st->nfault = p->nfault;
+      st->nprefault = p->nprefault;
+      st->nexecfault = p->nexecfault;
+      release(&ptable.lock);
+      return 0;
+    }
+  }
+  release(&ptable.lock);
+  return -1;
+}
+
+// Choose a user page to page out, with a clock over all processes'
+// memory, and make its PTE the swapped-out entry swpte.  Returns
+// the page's kernel address, or 0 if there is nothing to page out.
+// Only processes that are off the CPU, or the caller itself, are
+// candidates.  An idle CPU may still have a candidate's page table
+// loaded (see scheduler()), so clearing tlbcpu makes the candidate
+// reload %cr3 before it runs again.  A process in a system call
+// keeps its pages: the kernel may be using them with spinlocks held.
+char*
+swapvictim(uint swpte)
+{
+  static struct proc *hand = ptable.proc;
+  static uint handva;
+  struct proc *p;
+  char *mem;
+  int n;
+
+  acquire(&ptable.lock);
+  // Twice round: the first pass may only clear accessed bits.
+  for(n = 0; n <= 2*NPROC; n++){
+    p = hand;
+    if(p->sz > 0 && !p->insyscall &&
+       (p->state == RUNNABLE || p->state == SLEEPING || p == myproc())){
+      mem = clockscan(p->pgdir, p->sz, &handva, swpte);
+      if(p == myproc())
+        lcr3(V2P(p->pgdir));
+      else
+        p->tlbcpu = 0;
+      if(mem){
+        release(&ptable.lock);
+        return mem;
+      }
+    }
+    handva = 0;
+    if(++hand == &ptable.proc[NPROC])
+      hand = ptable.proc;
+  }
+  release(&ptable.lock);
+  return 0;
+}
+
 //PAGEBREAK: 36
 // Print a process listing to console.  For debugging.
 // Runs when user types ^P on console.
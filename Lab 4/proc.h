@@ -8,6 +8,7 @@ struct cpu {
   int ncli;                    // Depth of pushcli nesting.
   int intena;                  // Were interrupts enabled before pushcli?
   struct proc *proc;           // The process running on this cpu or null
+  pde_t *pgdir;                // Page table loaded in %cr3
 };
 
 extern struct cpu cpus[NCPU];
@@ -34,6 +35,26 @@ struct context {
 
 enum procstate { UNUSED, EMBRYO, SLEEPING, RUNNABLE, RUNNING, ZOMBIE };
 
+// A loadable segment of the process's executable.  Its pages are
+// read in from the inode the first time they are touched.
+struct seg {
+  uint va;                     // Start address, page aligned
+  uint memsz;                  // Bytes of memory the segment spans
+  uint off;                    // Offset of the segment in the file
+  uint filesz;                 // Bytes to read from the file; rest is zero
+};
+
+// A region set up by mmap(); see mmap.c.
+struct vma {
+  uint start;                  // First address, page aligned
+  uint end;                    // One past the last; start == end if unused
+  int prot;                    // PROT_READ, PROT_WRITE
+  int flags;                   // MAP_SHARED, MAP_PRIVATE, MAP_ANONYMOUS
+  struct file *f;              // Mapped file, or 0 if anonymous
+  uint off;                    // File offset of start
+  struct shmseg *shm;          // Shared memory segment, or 0; see shm.c
+};
+
 // Per-process state
 struct proc {
   uint sz;                     // Size of process memory (bytes)
@@ -46,9 +67,25 @@ struct proc {
   struct context *context;     // swtch() here to run process
   void *chan;                  // If non-zero, sleeping on chan
   int killed;                  // If non-zero, have been killed
+  int insyscall;               // In a system call: don't page out
   struct file *ofile[NOFILE];  // Open files
   struct inode *cwd;           // Current directory
   char name[16];               // Process name (debugging)
+  uint lastfault;              // Last page mapped by lazyfault()
+  uint fawin;                  // Pages lazyfault() maps per fault now
+  uint famax;                  // Fault-around limit in pages (1 = off)
+  int superpages;              // Map whole 4 MB heap ranges on a fault
+  uint ramax;                  // File readahead limit in blocks (0 = off)
+  struct cpu *tlbcpu;          // Only cpu whose TLB may hold our mappings
+  uint nfault;                 // Lazy heap faults taken
+  uint nprefault;              // Pages mapped ahead of a fault
+  uint nexecfault;             // Pages read in from the executable
+  uint npgfault;               // Page faults resolved
+  uint nmajfault;              // ... of which read from swap or a file
+  struct inode *exe;           // Executable backing seg[]
+  struct seg seg[NSEG];        // Demand-loaded executable segments
+  int nseg;
+  struct vma vma[NVMA];        // mmap() regions
 };
 
 // Process memory is laid out contiguously, low addresses first:
@@ -0,0 +1,72 @@
+// Read a file sequentially from a cold buffer cache, once with
+// readahead off and once with it on, and report the ticks and
+// the block reads each pass had to wait for.  With no file named,
+// write a scratch file of up to MAXKB (less if the largest file
+// the file system allows is smaller).
+//
+// usage: readbench [file]
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+#include "fsstat.h"
+
+#define SCRATCH "readbench.tmp"
+#define MAXKB   1024
+
+static char buf[512];
+
+static void
+pass(char *path, int ra)
+{
+  struct fsstat st0, st1;
+  int fd, n, tot, t;
+
+  dropcaches();
+  readahead(ra);
+  if((fd = open(path, O_RDONLY)) < 0){
+    printf(2, "readbench: cannot open %s\n", path);
+    exit();
+  }
+  fsstat(&st0);
+  t = uptime();
+  tot = 0;
+  while((n = read(fd, buf, sizeof(buf))) > 0)
+    tot += n;
+  t = uptime() - t;
+  fsstat(&st1);
+  close(fd);
+  printf(1, "readahead %d: %d KB, %d ticks, %d waits, %d read ahead\n",
+         ra, tot/1024, t, st1.nmiss - st0.nmiss,
+         st1.nreadahead - st0.nreadahead);
+}
+
+int
+main(int argc, char *argv[])
+{
+  char *path;
+  int fd, ra, i;
+
+  path = SCRATCH;
+  if(argc > 1)
+    path = argv[1];
+  else {
+    if((fd = open(path, O_CREATE|O_RDWR)) < 0){
+      printf(2, "readbench: cannot create %s\n", path);
+      exit();
+    }
+    for(i = 0; i < MAXKB*2; i++)
+      if(write(fd, buf, sizeof(buf)) != sizeof(buf))
+        break;
+    close(fd);
+  }
+
+  ra = readahead(0);
+  pass(path, 0);
+  pass(path, ra);
+  readahead(ra);
+  if(argc <= 1)
+    unlink(path);
+  exit();
+}
@@ -0,0 +1,213 @@
+// Shared memory segments.
+//
+// shmget(key, size) finds the segment with the given key, or
+// creates one of size bytes; key 0 always creates a new segment.
+// shmat(id) maps a segment read-write into the caller's address
+// space, as a region above the heap like those mmap() makes (see
+// mmap.c), and shmdt(addr) unmaps it again.  Every process that
+// attaches a segment maps the same physical pages.  A page is
+// allocated, zeroed, the first time any of them touches it.
+//
+// fork() inherits attachments.  When the last attachment goes,
+// whether by shmdt(), exit() or exec(), the pages are freed and
+// the segment disappears.  A segment that has never been attached
+// disappears when the process that created it exits, or when
+// shmrm(id) is called.  shmrm() of an attached segment only stops
+// shmget() and shmat() from finding it; it goes with its last
+// attachment.  An id names one segment for good: shmat() of an id
+// whose segment has gone fails.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "spinlock.h"
+#include "proc.h"
+
+struct shmseg {
+  int id;                      // shmget() handle; 0 if slot unused
+  int key;
+  uint npages;
+  int nattach;                 // regions mapping the segment
+  int creator;                 // pid of the process that made it
+  int removed;                 // shmrm() called; no more attachments
+  char *pages[SHMMAXPAGES];    // kernel addresses, 0 until touched
+};
+
+struct {
+  struct spinlock lock;
+  int nextseq;
+  struct shmseg seg[NSHM];
+} shm;
+
+void
+shminit(void)
+{
+  initlock(&shm.lock, "shm");
+  shm.nextseq = 1;
+}
+
+// Return the id of the segment with key, creating a segment of
+// size bytes if there is none.  Returns -1 if the segment exists
+// but is smaller than size, or if there is no room for a new one.
+int
+shmget(int key, uint size)
+{
+  struct shmseg *s, *free;
+  int id;
+
+  if(size == 0 || size > SHMMAXPAGES*PGSIZE)
+    return -1;
+  acquire(&shm.lock);
+  free = 0;
+  for(s = shm.seg; s < &shm.seg[NSHM]; s++){
+    if(s->id == 0){
+      if(free == 0)
+        free = s;
+    } else if(key != 0 && s->key == key && !s->removed){
+      id = s->npages*PGSIZE >= size ? s->id : -1;
+      release(&shm.lock);
+      return id;
+    }
+  }
+  if(free == 0){
+    release(&shm.lock);
+    return -1;
+  }
+  free->id = shm.nextseq++ * NSHM + (free - shm.seg);
+  free->key = key;
+  free->npages = PGROUNDUP(size) / PGSIZE;
+  free->nattach = 0;
+  free->creator = myproc()->pid;
+  free->removed = 0;
+  id = free->id;
+  release(&shm.lock);
+  return id;
+}
+
+// Take an attachment to segment id.  Returns the segment, and its
+// size in *len, or 0 if there is no such segment.
+struct shmseg*
+shmattach(int id, uint *len)
+{
+  struct shmseg *s;
+
+  if(id < NSHM)
+    return 0;
+  s = &shm.seg[id % NSHM];
+  acquire(&shm.lock);
+  if(s->id != id || s->removed){
+    release(&shm.lock);
+    return 0;
+  }
+  s->nattach++;
+  *len = s->npages * PGSIZE;
+  release(&shm.lock);
+  return s;
+}
+
+// Take another attachment to s, for fork() or a split region.
+void
+shmdup(struct shmseg *s)
+{
+  acquire(&shm.lock);
+  if(s->nattach < 1)
+    panic("shmdup");
+  s->nattach++;
+  release(&shm.lock);
+}
+
+// Free s's pages and its slot.  Caller holds shm.lock.
+static void
+shmfree(struct shmseg *s)
+{
+  uint i;
+
+  for(i = 0; i < s->npages; i++){
+    if(s->pages[i])
+      kfree(s->pages[i]);
+    s->pages[i] = 0;
+  }
+  s->id = 0;
+}
+
+// Drop an attachment to s.  The caller has already unmapped
+// its pages.  The last one frees the segment.
+void
+shmput(struct shmseg *s)
+{
+  acquire(&shm.lock);
+  if(s->nattach < 1)
+    panic("shmput");
+  if(--s->nattach == 0)
+    shmfree(s);
+  release(&shm.lock);
+}
+
+// Remove segment id: free it now if it is not attached, or
+// else when its last attachment goes.  Returns -1 if there is
+// no such segment.
+int
+shmrm(int id)
+{
+  struct shmseg *s;
+
+  if(id < NSHM)
+    return -1;
+  s = &shm.seg[id % NSHM];
+  acquire(&shm.lock);
+  if(s->id != id || s->removed){
+    release(&shm.lock);
+    return -1;
+  }
+  if(s->nattach == 0)
+    shmfree(s);
+  else
+    s->removed = 1;
+  release(&shm.lock);
+  return 0;
+}
+
+// Process pid is exiting: free the segments it created that
+// were never attached, so they do not hold their slots forever.
+void
+shmexit(int pid)
+{
+  struct shmseg *s;
+
+  acquire(&shm.lock);
+  for(s = shm.seg; s < &shm.seg[NSHM]; s++)
+    if(s->id != 0 && s->creator == pid && s->nattach == 0)
+      shmfree(s);
+  release(&shm.lock);
+}
+
+// Return the kernel address of page i of s, allocating it if no
+// one has touched it yet.  The caller holds an attachment.
+// Returns 0 if out of memory.
+char*
+shmpage(struct shmseg *s, uint i)
+{
+  char *mem, *pg;
+
+  if(i >= s->npages)
+    panic("shmpage");
+  mem = 0;
+  acquire(&shm.lock);
+  while((pg = s->pages[i]) == 0 && mem == 0){
+    // Allocate without the lock: kallocswap_zeroed() may sleep.
+    release(&shm.lock);
+    if((mem = kallocswap_zeroed()) == 0)
+      return 0;
+    acquire(&shm.lock);
+  }
+  if(pg == 0){
+    pg = s->pages[i] = mem;
+    mem = 0;
+  }
+  release(&shm.lock);
+  if(mem)
+    kfree(mem);  // someone else got there first
+  return pg;
+}
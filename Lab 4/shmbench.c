@@ -0,0 +1,111 @@
+// Stream data from a parent to a child, first through a pipe and
+// then through a ring buffer in a shared memory segment, and
+// report the ticks each took.  The ring's reader and writer spin
+// while it is empty or full, so it is only fast with more than
+// one CPU.
+//
+// usage: shmbench [kilobytes]
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+
+#define CHUNK    512
+#define RINGSIZE (16*1024)
+
+struct ring {
+  volatile uint head;    // bytes written so far
+  volatile uint tail;    // bytes read so far
+  char buf[RINGSIZE];
+};
+
+// Keep the compiler from moving loads and stores across this.
+// (x86 keeps stores in order, and loads in order, by itself.)
+#define barrier() asm volatile("" ::: "memory")
+
+static char chunk[CHUNK];
+
+static void
+pipebench(int nbytes)
+{
+  int fds[2], n, t, got;
+
+  if(pipe(fds) < 0){
+    printf(2, "shmbench: pipe failed\n");
+    exit();
+  }
+  t = uptime();
+  if(fork() == 0){
+    close(fds[1]);
+    got = 0;
+    while((n = read(fds[0], chunk, CHUNK)) > 0)
+      got += n;
+    if(got != nbytes)
+      printf(2, "shmbench: pipe lost data\n");
+    exit();
+  }
+  close(fds[0]);
+  for(n = 0; n < nbytes; n += CHUNK)
+    write(fds[1], chunk, CHUNK);
+  close(fds[1]);
+  wait();
+  printf(1, "pipe: %d KB, %d ticks\n", nbytes/1024, uptime() - t);
+}
+
+static void
+shmringbench(int nbytes)
+{
+  struct ring *r;
+  uint i, n;
+  int id, t;
+
+  if((id = shmget(0, sizeof(struct ring))) < 0 ||
+     (r = shmat(id)) == (struct ring*)-1){
+    printf(2, "shmbench: shmget/shmat failed\n");
+    exit();
+  }
+  t = uptime();
+  if(fork() == 0){
+    for(i = 0; i < nbytes; i += n){
+      while(r->head == r->tail)
+        ;
+      barrier();
+      n = r->head - r->tail;
+      if(n > CHUNK)
+        n = CHUNK;
+      memmove(chunk, r->buf + r->tail % RINGSIZE, n);
+      barrier();
+      r->tail += n;
+    }
+    exit();
+  }
+  for(i = 0; i < nbytes; i += CHUNK){
+    while(r->head - r->tail > RINGSIZE - CHUNK)
+      ;
+    barrier();
+    memmove(r->buf + r->head % RINGSIZE, chunk, CHUNK);
+    barrier();
+    r->head += CHUNK;
+  }
+  wait();
+  printf(1, "shared memory ring: %d KB, %d ticks\n", nbytes/1024,
+         uptime() - t);
+  shmdt(r);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int kb;
+
+  kb = 4096;
+  if(argc > 1)
+    kb = atoi(argv[1]);
+  if(kb <= 0){
+    printf(2, "usage: shmbench [kilobytes]\n");
+    exit();
+  }
+  pipebench(kb * 1024);
+  shmringbench(kb * 1024);
+  exit();
+}
@@ -0,0 +1,267 @@
+// Slab allocator for small kernel objects.
+//
+// A cache hands out objects of one fixed size.  Objects are carved
+// out of whole pages from kalloc() ("slabs"); each slab starts with a
+// struct slab header followed by as many objects as fit.  The optional
+// constructor runs once when a slab is created, so objects come back
+// from kmem_cache_alloc() in their constructed state and must be
+// returned to kmem_cache_free() in that state too.  So that nothing
+// disturbs that state, a free object is linked to the next through a
+// word just past its end, not through the object itself.
+//
+// Each CPU keeps a small stack of free objects per cache, so the
+// common alloc/free pair touches neither the cache lock nor the
+// slab lists.  The cpu stacks are refilled from, and drained to,
+// the slabs half a stack at a time.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "x86.h"
+#include "proc.h"
+#include "spinlock.h"
+#include "slabinfo.h"
+
+#define NCPUOBJ   16   // free objects held per cpu per cache
+
+struct slab {
+  struct slab *next;
+  struct kmem_cache *cache;
+  void *free;          // free objects in this slab, linked through
+                       // the word after each (see NEXTFREE)
+  uint inuse;          // objects handed out (or held by cpus)
+};
+
+struct kmem_cache {
+  struct spinlock lock;
+  char *name;
+  uint size;           // object size, word aligned
+  uint stride;         // ... plus the free link
+  uint perslab;        // objects per slab
+  void (*ctor)(void*);
+  struct slab *partial;  // some objects free
+  struct slab *full;     // no objects free
+  struct slab *empty;    // all objects free
+  uint nslabs;
+  struct {
+    int n;
+    void *obj[NCPUOBJ];
+  } cpu[NCPU];
+};
+
+struct {
+  struct spinlock lock;
+  int n;
+  struct kmem_cache cache[NCACHE];
+} slabs;
+
+// The free link of object obj of cache c.
+#define NEXTFREE(c, obj) (*(void**)((char*)(obj) + (c)->size))
+
+void
+slabinit(void)
+{
+  initlock(&slabs.lock, "slabs");
+}
+
+// Create a cache of objects of the given size.
+// ctor, if non-zero, initializes each new object.
+struct kmem_cache*
+kmem_cache_create(char *name, uint size, void (*ctor)(void*))
+{
+  struct kmem_cache *c;
+
+  size = (size + sizeof(void*) - 1) & ~(sizeof(void*) - 1);
+  if(size + sizeof(void*) + sizeof(struct slab) > PGSIZE)
+    panic("kmem_cache_create: object too big");
+
+  acquire(&slabs.lock);
+  if(slabs.n == NCACHE)
+    panic("kmem_cache_create: too many caches");
+  c = &slabs.cache[slabs.n++];
+  release(&slabs.lock);
+
+  initlock(&c->lock, name);
+  c->name = name;
+  c->size = size;
+  c->stride = size + sizeof(void*);
+  c->perslab = (PGSIZE - sizeof(struct slab)) / c->stride;
+  c->ctor = ctor;
+  return c;
+}
+
+static void
+slabpush(struct slab **list, struct slab *s)
+{
+  s->next = *list;
+  *list = s;
+}
+
+static void
+slabunlink(struct slab **list, struct slab *s)
+{
+  struct slab **pp;
+
+  for(pp = list; *pp; pp = &(*pp)->next){
+    if(*pp == s){
+      *pp = s->next;
+      return;
+    }
+  }
+  panic("slabunlink");
+}
+
+// Allocate and construct a new slab.  Caller holds c->lock.
+static struct slab*
+slabgrow(struct kmem_cache *c)
+{
+  struct slab *s;
+  char *obj;
+  int i;
+
+  if((s = (struct slab*)kalloc()) == 0)
+    return 0;
+  s->cache = c;
+  s->inuse = 0;
+  s->free = 0;
+  obj = (char*)(s + 1) + (c->perslab - 1) * c->stride;
+  for(i = 0; i < c->perslab; i++, obj -= c->stride){
+    if(c->ctor)
+      c->ctor(obj);
+    NEXTFREE(c, obj) = s->free;
+    s->free = obj;
+  }
+  c->nslabs++;
+  slabpush(&c->empty, s);
+  return s;
+}
+
+// Take one object off the slab lists.  Caller holds c->lock.
+static void*
+slaballoc(struct kmem_cache *c)
+{
+  struct slab *s;
+  void *obj;
+
+  if((s = c->partial) != 0)
+    c->partial = s->next;
+  else if((s = c->empty) != 0 || (s = slabgrow(c)) != 0)
+    slabunlink(&c->empty, s);
+  else
+    return 0;
+
+  obj = s->free;
+  s->free = NEXTFREE(c, obj);
+  s->inuse++;
+  if(s->free)
+    slabpush(&c->partial, s);
+  else
+    slabpush(&c->full, s);
+  return obj;
+}
+
+// Return one object to its slab.  Caller holds c->lock.
+static void
+slabfree(struct kmem_cache *c, void *obj)
+{
+  struct slab *s;
+
+  s = (struct slab*)PGROUNDDOWN((uint)obj);
+  if(s->cache != c)
+    panic("kmem_cache_free: wrong cache");
+  if(s->free == 0)
+    slabunlink(&c->full, s);
+  else
+    slabunlink(&c->partial, s);
+  NEXTFREE(c, obj) = s->free;
+  s->free = obj;
+  if(--s->inuse == 0){
+    // Keep one empty slab around; give the rest back.
+    if(c->empty){
+      c->nslabs--;
+      kfree((char*)s);
+    } else
+      slabpush(&c->empty, s);
+  } else
+    slabpush(&c->partial, s);
+}
+
+void*
+kmem_cache_alloc(struct kmem_cache *c)
+{
+  void *obj;
+  int id, n;
+
+  pushcli();
+  id = cpuid();
+  if(c->cpu[id].n > 0){
+    obj = c->cpu[id].obj[--c->cpu[id].n];
+    popcli();
+    return obj;
+  }
+
+  // Refill half of this cpu's stack and hand out one more.
+  acquire(&c->lock);
+  for(n = 0; n < NCPUOBJ/2; n++){
+    if((obj = slaballoc(c)) == 0)
+      break;
+    c->cpu[id].obj[c->cpu[id].n++] = obj;
+  }
+  obj = slaballoc(c);
+  release(&c->lock);
+  popcli();
+  return obj;
+}
+
+void
+kmem_cache_free(struct kmem_cache *c, void *obj)
+{
+  int id;
+
+  pushcli();
+  id = cpuid();
+  if(c->cpu[id].n == NCPUOBJ){
+    // Drain half of this cpu's stack back to the slabs.
+    acquire(&c->lock);
+    while(c->cpu[id].n > NCPUOBJ/2)
+      slabfree(c, c->cpu[id].obj[--c->cpu[id].n]);
+    release(&c->lock);
+  }
+  c->cpu[id].obj[c->cpu[id].n++] = obj;
+  popcli();
+}
+
+// Fill in usage for up to n caches; return how many.
+int
+slabinfo(struct slabinfo *si, int n)
+{
+  struct kmem_cache *c;
+  struct slab *s;
+  int i, j;
+
+  acquire(&slabs.lock);
+  if(n > slabs.n)
+    n = slabs.n;
+  release(&slabs.lock);
+  for(i = 0; i < n; i++){
+    c = &slabs.cache[i];
+    acquire(&c->lock);
+    safestrcpy(si[i].name, c->name, sizeof(si[i].name));
+    si[i].size = c->size;
+    si[i].perslab = c->perslab;
+    si[i].nslabs = c->nslabs;
+    si[i].active = 0;
+    for(s = c->partial; s; s = s->next)
+      si[i].active += s->inuse;
+    for(s = c->full; s; s = s->next)
+      si[i].active += s->inuse;
+    si[i].cpucached = 0;
+    for(j = 0; j < ncpu; j++)
+      si[i].cpucached += c->cpu[j].n;
+    si[i].active -= si[i].cpucached;
+    release(&c->lock);
+  }
+  return n;
+}
@@ -0,0 +1,24 @@
+// Print memory used by each kernel slab cache.
+
+#include "types.h"
+#include "slabinfo.h"
+#include "user.h"
+
+struct slabinfo si[16];
+
+int
+main(int argc, char *argv[])
+{
+  int i, n;
+
+  if((n = slabinfo(si, sizeof(si)/sizeof(si[0]))) < 0){
+    printf(2, "slabinfo: failed\n");
+    exit();
+  }
+  printf(1, "cache\tsize\tper slab\tslabs\tactive\tcpu cached\tKB\n");
+  for(i = 0; i < n; i++)
+    printf(1, "%s\t%d\t%d\t\t%d\t%d\t%d\t\t%d\n", si[i].name, si[i].size,
+           si[i].perslab, si[i].nslabs, si[i].active, si[i].cpucached,
+           si[i].nslabs*4);
+  exit();
+}
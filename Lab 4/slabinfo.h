@@ -0,0 +1,10 @@
+// Per-cache usage of the kernel slab allocator,
+// filled in by the slabinfo() system call.
+struct slabinfo {
+  char name[16];
+  uint size;        // object size in bytes
+  uint perslab;     // objects per 4096-byte slab
+  uint nslabs;      // slabs (pages) held by the cache
+  uint active;      // objects in use
+  uint cpucached;   // free objects parked on per-cpu stacks
+};
@@ -0,0 +1,76 @@
+// Touch a large sbrk'd heap at random, first with 4 MB superpages
+// disabled and then enabled, and report the ticks each pass took
+// and how the heap ended up mapped.  Each pass runs in a fresh
+// child so that it starts from an unmapped heap.
+//
+// usage: superbench [megabytes [accesses]]
+
+#include "types.h"
+#include "stat.h"
+#include "memstat.h"
+#include "user.h"
+
+#define PGSIZE  4096
+#define SPGSIZE (4*1024*1024)
+
+static void
+run(char *label, int on, int mb, int naccess)
+{
+  struct memstat st;
+  char *p;
+  uint sz, x;
+  int i, t, sum;
+
+  if(fork() != 0){
+    wait();
+    return;
+  }
+  superpages(on);
+
+  // Start the region on a 4 MB boundary.
+  sz = (uint)sbrk(0);
+  if(sz % SPGSIZE)
+    sbrk(SPGSIZE - sz % SPGSIZE);
+  if((p = sbrk(mb * 1024 * 1024)) == (char*)-1){
+    printf(2, "superbench: sbrk failed\n");
+    exit();
+  }
+
+  t = uptime();
+  for(i = 0; i < mb * 1024 * 1024; i += PGSIZE)
+    p[i] = i;
+  x = 1;
+  sum = 0;
+  for(i = 0; i < naccess; i++){
+    x = x * 1103515245 + 12345;
+    sum += p[(x >> 4) % (mb * 1024 * 1024)]++;
+  }
+  t = uptime() - t;
+  memstat(0, &st);
+
+  printf(1, "%s: %d MB, %d accesses, %d ticks, %d superpages, "
+         "%d resident, %d faults (%d)\n", label, mb, naccess, t,
+         st.superpages, st.resident, st.nfault, sum & 1);
+  exit();
+}
+
+int
+main(int argc, char *argv[])
+{
+  int mb, naccess;
+
+  mb = 16;
+  naccess = 4000000;
+  if(argc > 1)
+    mb = atoi(argv[1]);
+  if(argc > 2)
+    naccess = atoi(argv[2]);
+  if(mb <= 0 || naccess < 0){
+    printf(2, "usage: superbench [megabytes [accesses]]\n");
+    exit();
+  }
+
+  run("4 KB pages", 0, mb, naccess);
+  run("superpages", 1, mb, naccess);
+  exit();
+}
@@ -0,0 +1,262 @@
+// Paging user memory out to a swap area on disk.
+//
+// mkfs reserves sb.nswap blocks after the file system, starting at
+// sb.swapstart.  The swap area is divided into page-sized slots.
+// A page that has been paged out has a PTE with PTE_P clear and
+// PTE_SWAP set; the slot number is kept in the address bits and
+// the PTE_W and PTE_U bits are kept, so swapin() can restore them.
+//
+// The kswapd kernel thread pages out when free memory drops below
+// SWAPLOW pages, until there are SWAPHIGH free again; it shrinks
+// the buffer cache first, while that has buffers to spare.  Victims are
+// chosen by a clock over all processes' pages (see swapvictim() in
+// proc.c): a page whose accessed bit is set gets it cleared and a
+// second chance.  If a page allocation for user memory fails
+// anyway, kallocswap() pages out directly.
+//
+// All swap I/O goes through one private buffer; holding its
+// sleeplock also serializes page-outs, so a slot is never reused
+// while an old write to it is still in flight.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "proc.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "buf.h"
+#include "kmemstat.h"
+
+#define BPP      (PGSIZE/BSIZE)  // blocks per page
+#define NSLOT    (SWAPSIZE/BPP)
+#define BSHRINK  16   // buffers kswapd frees at a time
+
+struct {
+  struct spinlock lock;   // protects used[] and the counters
+  uint dev;
+  uint start;             // first block of the swap area
+  uint nslot;
+  uint nused;
+  uint next;              // where to start looking for a free slot
+  uint npagein;
+  uint npageout;
+  uchar used[NSLOT/8];
+} swap;
+
+static struct buf swapbuf;
+
+pte_t *walkpgdir(pde_t *pgdir, const void *va, int alloc);
+
+static void kswapd(void);
+
+// Called once, in process context, after the file system is up.
+void
+swapinit(int dev)
+{
+  struct superblock sb;
+
+  initlock(&swap.lock, "swap");
+  initsleeplock(&swapbuf.lock, "swapbuf");
+  readsb(dev, &sb);
+  if(sb.nswap == 0)
+    return;
+  swap.dev = dev;
+  swap.start = sb.swapstart;
+  swap.nslot = sb.nswap / BPP;
+  if(swap.nslot > NSLOT)
+    swap.nslot = NSLOT;
+  kthread("kswapd", kswapd);
+}
+
+// Allocate a free slot.  Returns -1 if swap is full.
+static int
+slotalloc(void)
+{
+  uint i, s;
+
+  acquire(&swap.lock);
+  for(i = 0; i < swap.nslot; i++){
+    s = (swap.next + i) % swap.nslot;
+    if(!(swap.used[s/8] & (1 << (s%8)))){
+      swap.used[s/8] |= 1 << (s%8);
+      swap.nused++;
+      swap.next = s + 1;
+      release(&swap.lock);
+      return s;
+    }
+  }
+  release(&swap.lock);
+  return -1;
+}
+
+// Free the slot in a swapped-out PTE.
+void
+swapfree(uint pte)
+{
+  uint s = PTE_ADDR(pte) >> PTXSHIFT;
+
+  acquire(&swap.lock);
+  if(s >= swap.nslot || !(swap.used[s/8] & (1 << (s%8))))
+    panic("swapfree");
+  swap.used[s/8] &= ~(1 << (s%8));
+  swap.nused--;
+  release(&swap.lock);
+}
+
+// Read or write page mem from or to slot s.
+// Caller holds swapbuf.lock.
+static void
+swaprw(uint s, char *mem, int write)
+{
+  int i;
+
+  for(i = 0; i < BPP; i++){
+    swapbuf.dev = swap.dev;
+    swapbuf.blockno = swap.start + s*BPP + i;
+    if(write){
+      memmove(swapbuf.data, mem + i*BSIZE, BSIZE);
+      swapbuf.flags = B_DIRTY;
+    } else
+      swapbuf.flags = 0;
+    iderw(&swapbuf);
+    if(!write)
+      memmove(mem + i*BSIZE, swapbuf.data, BSIZE);
+  }
+}
+
+// Copy the page in swapped-out PTE pte into mem.
+// The slot stays allocated.
+void
+swapread(uint pte, char *mem)
+{
+  acquiresleep(&swapbuf.lock);
+  swaprw(PTE_ADDR(pte) >> PTXSHIFT, mem, 0);
+  releasesleep(&swapbuf.lock);
+}
+
+// Page out one user page.
+// Returns 0 on success, -1 if swap is full or there is no victim.
+int
+swapout(void)
+{
+  char *mem;
+  int s;
+
+  if(swap.nslot == 0)
+    return -1;
+  acquiresleep(&swapbuf.lock);
+  if((s = slotalloc()) < 0){
+    releasesleep(&swapbuf.lock);
+    return -1;
+  }
+  if((mem = swapvictim((s << PTXSHIFT) | PTE_SWAP)) == 0){
+    releasesleep(&swapbuf.lock);
+    swapfree(s << PTXSHIFT);
+    return -1;
+  }
+  // The victim's PTE already points at the slot.  If its process
+  // faults on the page now, swapin() waits for us to finish.
+  swaprw(s, mem, 1);
+  releasesleep(&swapbuf.lock);
+  kfree(mem);
+  acquire(&swap.lock);
+  swap.npageout++;
+  release(&swap.lock);
+  return 0;
+}
+
+// Bring the page at va in p back in from swap.
+int
+swapin(struct proc *p, uint va)
+{
+  char *mem;
+  pte_t *pte;
+  uint s;
+
+  if((mem = kallocswap()) == 0)
+    return -1;
+  acquiresleep(&swapbuf.lock);
+  if((pte = walkpgdir(p->pgdir, (char*)va, 0)) == 0 || !(*pte & PTE_SWAP))
+    panic("swapin");
+  s = PTE_ADDR(*pte) >> PTXSHIFT;
+  swaprw(s, mem, 0);
+  *pte = V2P(mem) | (*pte & (PTE_W|PTE_U)) | PTE_A | PTE_P;
+  releasesleep(&swapbuf.lock);
+  swapfree(s << PTXSHIFT);
+  p->nmajfault++;
+  acquire(&swap.lock);
+  swap.npagein++;
+  release(&swap.lock);
+  return 0;
+}
+
+// Allocate a page for user memory, paging out to make room
+// if necessary.  May sleep.
+char*
+kallocswap(void)
+{
+  char *mem;
+
+  while((mem = kalloc()) == 0)
+    if(swapout() < 0)
+      return 0;
+  return mem;
+}
+
+// Like kallocswap(), but the page comes filled with zeros.
+char*
+kallocswap_zeroed(void)
+{
+  char *mem;
+
+  while((mem = kalloc_zeroed()) == 0)
+    if(swapout() < 0)
+      return 0;
+  return mem;
+}
+
+// Wake kswapd; kalloc() calls this when memory runs low.
+void
+swapwake(void)
+{
+  if(swap.nslot)
+    wakeup(&swap);
+}
+
+static void
+kswapd(void)
+{
+  for(;;){
+    acquire(&swap.lock);
+    while(kfreepages() >= SWAPLOW)
+      sleep(&swap, &swap.lock);
+    release(&swap.lock);
+    while(kfreepages() < SWAPHIGH){
+      // Drop cached disk blocks before paging out user memory.
+      if(bshrink(BSHRINK) > 0)
+        continue;
+      if(swapout() < 0){
+        // Nothing to page out right now; try again later.
+        acquire(&tickslock);
+        sleep(&ticks, &tickslock);
+        release(&tickslock);
+        break;
+      }
+    }
+  }
+}
+
+// Fill in the swap part of the allocator statistics.
+void
+swapstat(struct kmemstat *st)
+{
+  acquire(&swap.lock);
+  st->nswap = swap.nslot;
+  st->swapused = swap.nused;
+  st->npagein = swap.npagein;
+  st->npageout = swap.npageout;
+  release(&swap.lock);
+}
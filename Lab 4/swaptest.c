@@ -0,0 +1,69 @@
+// Touch more memory than the machine has, so that pages must be
+// paged out to swap, then check that every page comes back intact.
+// Reports how many pages went out and came in, and how fast.
+//
+// usage: swaptest [pages]
+
+#include "types.h"
+#include "param.h"
+#include "kmemstat.h"
+#include "user.h"
+
+#define PGSIZE 4096
+
+static void
+report(char *phase, struct kmemstat *a, struct kmemstat *b, int ticks)
+{
+  int out, in;
+
+  out = b->npageout - a->npageout;
+  in = b->npagein - a->npagein;
+  if(ticks == 0)
+    ticks = 1;
+  printf(1, "%s: %d ticks, %d paged out, %d paged in (%d/%d per 100 ticks)\n",
+         phase, ticks, out, in, out*100/ticks, in*100/ticks);
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct kmemstat st0, st1, st2;
+  int npages, i, t0, t1, t2, bad;
+  char *p;
+
+  kmemstat(&st0);
+  if(st0.nswap == 0){
+    printf(2, "swaptest: no swap area\n");
+    exit();
+  }
+  npages = st0.npages + st0.npages/4;
+  if(argc > 1)
+    npages = atoi(argv[1]);
+  printf(1, "swaptest: %d pages, %d in the machine, %d swap slots\n",
+         npages, st0.npages, st0.nswap);
+  if((p = sbrk(npages*PGSIZE)) == (char*)-1){
+    printf(2, "swaptest: sbrk failed\n");
+    exit();
+  }
+
+  t0 = uptime();
+  for(i = 0; i < npages; i++)
+    *(int*)(p + i*PGSIZE) = i;
+  t1 = uptime();
+  kmemstat(&st1);
+
+  bad = 0;
+  for(i = 0; i < npages; i++)
+    if(*(int*)(p + i*PGSIZE) != i)
+      bad++;
+  t2 = uptime();
+  kmemstat(&st2);
+
+  report("write", &st0, &st1, t1 - t0);
+  report("read", &st1, &st2, t2 - t1);
+  if(bad)
+    printf(2, "swaptest: %d pages corrupted\n", bad);
+  else
+    printf(1, "swaptest ok\n");
+  exit();
+}
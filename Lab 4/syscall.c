@@ -17,32 +17,31 @@
 int
 fetchint(uint addr, int *ip)
 {
-  struct proc *curproc = myproc();
-
-  if(addr >= curproc->sz || addr+4 > curproc->sz)
-    return -1;
-  *ip = *(int*)(addr);
-  return 0;
+  return copy_from_user(ip, addr, sizeof(*ip));
 }
 
-// Fetch the nul-terminated string at addr from the current process.
-// Doesn't actually copy the string - just sets *pp to point at it.
-// Returns length of string, not including nul.
+// Copy the nul-terminated string at addr from the current process
+// into buf, which holds max bytes.  Returns length of string, not
+// including nul, or -1 if it does not fit.
+// The string is copied, not used in place, because it may lie in a
+// shared memory segment where another process can change it at any
+// time, even remove its nul after strlen_user() has found it.
 int
-fetchstr(uint addr, char **pp)
+fetchstr(uint addr, char *buf, int max)
 {
-  char *s, *ep;
-  struct proc *curproc = myproc();
+  uint n;
+  int len;
 
-  if(addr >= curproc->sz)
+  if(addr >= KERNBASE || max <= 0)
     return -1;
-  *pp = (char*)addr;
-  ep = (char*)curproc->sz;
-  for(s = *pp; s < ep; s++){
-    if(*s == 0)
-      return s - *pp;
-  }
-  return -1;
+  n = KERNBASE - addr;
+  if(n > max)
+    n = max;
+  if((len = strlen_user((char*)addr, n)) < 0 ||
+     copy_from_user(buf, addr, len) < 0)
+    return -1;
+  buf[len] = 0;
+  return len;
 }
 
 // Fetch the nth 32-bit system call argument.
@@ -63,23 +62,26 @@ argptr(int n, char **pp, int size)
  
   if(argint(n, &i) < 0)
     return -1;
-  if(size < 0 || (uint)i >= curproc->sz || (uint)i+size > curproc->sz)
+  if(size < 0)
+    return -1;
+  if((uint)i < curproc->sz && (uint)i+size <= curproc->sz){
+    if(uvmprefault(curproc, i, size) < 0)
+      return -1;
+  } else if(mmapprefault(curproc, i, size) < 0)
     return -1;
   *pp = (char*)i;
   return 0;
 }
 
-// Fetch the nth word-sized system call argument as a string pointer.
-// Check that the pointer is valid and the string is nul-terminated.
-// (There is no shared writable memory, so the string can't change
-// between this check and being used by the kernel.)
+// Fetch the nth word-sized system call argument as a string pointer,
+// and copy the string into buf, which holds max bytes.
 int
-argstr(int n, char **pp)
+argstr(int n, char *buf, int max)
 {
   int addr;
   if(argint(n, &addr) < 0)
     return -1;
-  return fetchstr(addr, pp);
+  return fetchstr(addr, buf, max);
 }
 
 extern int sys_chdir(void);
@@ -103,6 +105,22 @@ extern int sys_unlink(void);
 extern int sys_wait(void);
 extern int sys_write(void);
 extern int sys_uptime(void);
+extern int sys_kmemstat(void);
+extern int sys_slabinfo(void);
+extern int sys_memstat(void);
+extern int sys_faultaround(void);
+extern int sys_mmap(void);
+extern int sys_munmap(void);
+extern int sys_superpages(void);
+extern int sys_madvise(void);
+extern int sys_shmget(void);
+extern int sys_shmat(void);
+extern int sys_shmdt(void);
+extern int sys_fsstat(void);
+extern int sys_readahead(void);
+extern int sys_dropcaches(void);
+extern int sys_logcrash(void);
+extern int sys_shmrm(void);
 
 static int (*syscalls[])(void) = {
 [SYS_fork]    sys_fork,
@@ -126,6 +144,22 @@ static int (*syscalls[])(void) = {
 [SYS_link]    sys_link,
 [SYS_mkdir]   sys_mkdir,
 [SYS_close]   sys_close,
+[SYS_kmemstat] sys_kmemstat,
+[SYS_slabinfo] sys_slabinfo,
+[SYS_memstat] sys_memstat,
+[SYS_faultaround] sys_faultaround,
+[SYS_mmap]    sys_mmap,
+[SYS_munmap]  sys_munmap,
+[SYS_superpages] sys_superpages,
+[SYS_madvise] sys_madvise,
+[SYS_shmget]  sys_shmget,
+[SYS_shmat]   sys_shmat,
+[SYS_shmdt]   sys_shmdt,
+[SYS_fsstat]  sys_fsstat,
+[SYS_readahead] sys_readahead,
+[SYS_dropcaches] sys_dropcaches,
+[SYS_logcrash] sys_logcrash,
+[SYS_shmrm]   sys_shmrm,
 };
 
 void
@@ -135,6 +169,7 @@ syscall(void)
   struct proc *curproc = myproc();
 
   num = curproc->tf->eax;
+  curproc->insyscall = 1;
   if(num > 0 && num < NELEM(syscalls) && syscalls[num]) {
     curproc->tf->eax = syscalls[num]();
   } else {
@@ -142,4 +177,5 @@ syscall(void)
             curproc->pid, curproc->name, num);
     curproc->tf->eax = -1;
   }
+  curproc->insyscall = 0;
 }
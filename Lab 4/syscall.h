@@ -20,3 +20,19 @@
 #define SYS_link   19
 #define SYS_mkdir  20
 #define SYS_close  21
+#define SYS_kmemstat 22
+#define SYS_slabinfo 23
+#define SYS_memstat 24
+#define SYS_faultaround 25
+#define SYS_mmap 26
+#define SYS_munmap 27
+#define SYS_superpages 28
+#define SYS_madvise 29
+#define SYS_shmget 30
+#define SYS_shmat 31
+#define SYS_shmdt 32
+#define SYS_fsstat 33
+#define SYS_readahead 34
+#define SYS_dropcaches 35
+#define SYS_logcrash 36
+#define SYS_shmrm 37
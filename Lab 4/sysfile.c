@@ -15,6 +15,7 @@
 #include "sleeplock.h"
 #include "file.h"
 #include "fcntl.h"
+#include "fsstat.h"
 
 // Fetch the nth word-sized system call argument as a file descriptor
 // and return both the descriptor and the corresponding struct file.
@@ -107,21 +108,24 @@ int
 sys_fstat(void)
 {
   struct file *f;
-  struct stat *st;
+  struct stat st;
+  uint ust;
 
-  if(argfd(0, 0, &f) < 0 || argptr(1, (void*)&st, sizeof(*st)) < 0)
+  if(argfd(0, 0, &f) < 0 || argint(1, (int*)&ust) < 0)
     return -1;
-  return filestat(f, st);
+  if(filestat(f, &st) < 0)
+    return -1;
+  return copy_to_user(ust, &st, sizeof(st));
 }
 
 // Create the path new as a link to the same inode as old.
 int
 sys_link(void)
 {
-  char name[DIRSIZ], *new, *old;
+  char name[DIRSIZ], new[MAXPATH], old[MAXPATH];
   struct inode *dp, *ip;
 
-  if(argstr(0, &old) < 0 || argstr(1, &new) < 0)
+  if(argstr(0, old, sizeof(old)) < 0 || argstr(1, new, sizeof(new)) < 0)
     return -1;
 
   begin_op();
@@ -186,10 +190,10 @@ sys_unlink(void)
 {
   struct inode *ip, *dp;
   struct dirent de;
-  char name[DIRSIZ], *path;
+  char name[DIRSIZ], path[MAXPATH];
   uint off;
 
-  if(argstr(0, &path) < 0)
+  if(argstr(0, path, sizeof(path)) < 0)
     return -1;
 
   begin_op();
@@ -286,12 +290,12 @@ create(char *path, short type, short major, short minor)
 int
 sys_open(void)
 {
-  char *path;
+  char path[MAXPATH];
   int fd, omode;
   struct file *f;
   struct inode *ip;
 
-  if(argstr(0, &path) < 0 || argint(1, &omode) < 0)
+  if(argstr(0, path, sizeof(path)) < 0 || argint(1, &omode) < 0)
     return -1;
 
   begin_op();
@@ -336,11 +340,11 @@ sys_open(void)
 int
 sys_mkdir(void)
 {
-  char *path;
+  char path[MAXPATH];
   struct inode *ip;
 
   begin_op();
-  if(argstr(0, &path) < 0 || (ip = create(path, T_DIR, 0, 0)) == 0){
+  if(argstr(0, path, sizeof(path)) < 0 || (ip = create(path, T_DIR, 0, 0)) == 0){
     end_op();
     return -1;
   }
@@ -353,11 +357,11 @@ int
 sys_mknod(void)
 {
   struct inode *ip;
-  char *path;
+  char path[MAXPATH];
   int major, minor;
 
   begin_op();
-  if((argstr(0, &path)) < 0 ||
+  if((argstr(0, path, sizeof(path))) < 0 ||
      argint(1, &major) < 0 ||
      argint(2, &minor) < 0 ||
      (ip = create(path, T_DEV, major, minor)) == 0){
@@ -372,12 +376,12 @@ sys_mknod(void)
 int
 sys_chdir(void)
 {
-  char *path;
+  char path[MAXPATH];
   struct inode *ip;
   struct proc *curproc = myproc();
   
   begin_op();
-  if(argstr(0, &path) < 0 || (ip = namei(path)) == 0){
+  if(argstr(0, path, sizeof(path)) < 0 || (ip = namei(path)) == 0){
     end_op();
     return -1;
   }
@@ -394,52 +398,141 @@ sys_chdir(void)
   return 0;
 }
 
+// The argument strings are copied into one page; they have to
+// fit on the new program's one-page stack anyway.
 int
 sys_exec(void)
 {
-  char *path, *argv[MAXARG];
-  int i;
-  uint uargv, uarg;
+  char path[MAXPATH], *argv[MAXARG], *strs;
+  int i, n, r;
+  uint uargv, uarg, off;
 
-  if(argstr(0, &path) < 0 || argint(1, (int*)&uargv) < 0){
+  if(argstr(0, path, sizeof(path)) < 0 || argint(1, (int*)&uargv) < 0){
     return -1;
   }
+  if((strs = kalloc()) == 0)
+    return -1;
   memset(argv, 0, sizeof(argv));
+  r = -1;
+  off = 0;
   for(i=0;; i++){
     if(i >= NELEM(argv))
-      return -1;
+      goto bad;
     if(fetchint(uargv+4*i, (int*)&uarg) < 0)
-      return -1;
+      goto bad;
     if(uarg == 0){
       argv[i] = 0;
       break;
     }
-    if(fetchstr(uarg, &argv[i]) < 0)
-      return -1;
+    if((n = fetchstr(uarg, strs + off, PGSIZE - off)) < 0)
+      goto bad;
+    argv[i] = strs + off;
+    off += n + 1;
   }
-  return exec(path, argv);
+  r = exec(path, argv);
+bad:
+  kfree(strs);
+  return r;
 }
 
 int
 sys_pipe(void)
 {
-  int *fd;
+  uint ufd;
   struct file *rf, *wf;
-  int fd0, fd1;
+  int fd[2];
 
-  if(argptr(0, (void*)&fd, 2*sizeof(fd[0])) < 0)
+  if(argint(0, (int*)&ufd) < 0)
     return -1;
   if(pipealloc(&rf, &wf) < 0)
     return -1;
-  fd0 = -1;
-  if((fd0 = fdalloc(rf)) < 0 || (fd1 = fdalloc(wf)) < 0){
-    if(fd0 >= 0)
-      myproc()->ofile[fd0] = 0;
+  fd[0] = fd[1] = -1;
+  if((fd[0] = fdalloc(rf)) < 0 || (fd[1] = fdalloc(wf)) < 0 ||
+     copy_to_user(ufd, fd, sizeof(fd)) < 0){
+    if(fd[0] >= 0)
+      myproc()->ofile[fd[0]] = 0;
+    if(fd[1] >= 0)
+      myproc()->ofile[fd[1]] = 0;
     fileclose(rf);
     fileclose(wf);
     return -1;
   }
-  fd[0] = fd0;
-  fd[1] = fd1;
+  return 0;
+}
+
+// the address argument is only a hint and is ignored;
+// mmap() picks the address itself.
+int
+sys_mmap(void)
+{
+  int addr, len, prot, flags, off;
+  struct file *f;
+
+  if(argint(0, &addr) < 0 || argint(1, &len) < 0 || argint(2, &prot) < 0 ||
+     argint(3, &flags) < 0 || argint(5, &off) < 0)
+    return -1;
+  if(argfd(4, 0, &f) < 0)
+    f = 0;
+  if(len <= 0 || off < 0)
+    return -1;
+  return mmap(len, prot, flags, f, off);
+}
+
+int
+sys_munmap(void)
+{
+  int addr, len;
+
+  if(argint(0, &addr) < 0 || argint(1, &len) < 0 || len <= 0)
+    return -1;
+  return munmap(addr, len);
+}
+
+// report buffer cache and log statistics.
+int
+sys_fsstat(void)
+{
+  struct fsstat *st;
+
+  if(argptr(0, (void*)&st, sizeof(*st)) < 0)
+    return -1;
+  bstat(st);
+  logstat(st);
+  bfreestat(st);
+  istat(st);
+  return 0;
+}
+
+// set the most blocks readi() may read ahead of a sequential
+// reader (0 turns readahead off); returns the previous setting.
+int
+sys_readahead(void)
+{
+  int n, old;
+
+  if(argint(0, &n) < 0 || n < 0 || n > MAXREADAHEAD)
+    return -1;
+  old = myproc()->ramax;
+  myproc()->ramax = n;
+  return old;
+}
+
+// drop unused blocks from the buffer cache; returns how many.
+int
+sys_dropcaches(void)
+{
+  return bdrop();
+}
+
+// make the next log commit stop the machine at the given
+// LOGCRASH_* point, to test crash recovery; 0 cancels.
+int
+sys_logcrash(void)
+{
+  int point;
+
+  if(argint(0, &point) < 0 || point < 0 || point > LOGCRASH_NOINSTALL)
+    return -1;
+  logcrash(point);
   return 0;
 }
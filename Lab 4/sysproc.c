@@ -6,6 +6,10 @@
 #include "memlayout.h"
 #include "mmu.h"
 #include "proc.h"
+#include "kmemstat.h"
+#include "slabinfo.h"
+#include "memstat.h"
+#include "mman.h"
 
 int
 sys_fork(void)
@@ -51,6 +55,15 @@ sys_sbrk(void)
   if(argint(0, &n) < 0)
     return -1;
   addr = myproc()->sz;
+  if(n > 0 && addr + n > mmapbase(myproc()))
+    return -1;
+  if(n < 0){
+    if(addr + n < 0)
+      return -1;
+    // Shrinking: free the pages that were faulted in.
+    deallocuvm(myproc()->pgdir, addr, addr + n);
+    lcr3(V2P(myproc()->pgdir));
+  }
   myproc()->sz+=n;
   // if(growproc(n) < 0)
   //   return -1;
@@ -90,3 +103,150 @@ sys_uptime(void)
   release(&tickslock);
   return xticks;
 }
+
+// report free-block counts of the physical page allocator,
+// and swap usage.
+int
+sys_kmemstat(void)
+{
+  struct kmemstat *st;
+
+  if(argptr(0, (void*)&st, sizeof(*st)) < 0)
+    return -1;
+  kmemstat(st);
+  swapstat(st);
+  return 0;
+}
+
+// report per-cache usage of the slab allocator.
+int
+sys_slabinfo(void)
+{
+  struct slabinfo *si;
+  int n;
+
+  if(argint(1, &n) < 0 || n < 0)
+    return -1;
+  if(n > NCACHE)
+    n = NCACHE;  // no more to report, and n*sizeof(*si) can't wrap
+  if(argptr(0, (void*)&si, n*sizeof(*si)) < 0)
+    return -1;
+  return slabinfo(si, n);
+}
+
+// report memory statistics for a process (0 = this one).
+int
+sys_memstat(void)
+{
+  int pid;
+  struct memstat *st;
+
+  if(argint(0, &pid) < 0 || argptr(1, (void*)&st, sizeof(*st)) < 0)
+    return -1;
+  return procmemstat(pid, st);
+}
+
+// set the most pages one lazy heap fault may map;
+// returns the previous setting.
+int
+sys_faultaround(void)
+{
+  int n, old;
+
+  if(argint(0, &n) < 0 || n < 1 || n > MAXFAULTAROUND)
+    return -1;
+  old = myproc()->famax;
+  myproc()->famax = n;
+  return old;
+}
+
+// madvise(addr, len, advice): with MADV_DONTNEED, free the pages
+// of [addr, addr+len) below sz.  The range stays valid and faults
+// in again as if never touched.  MADV_NORMAL does nothing.
+int
+sys_madvise(void)
+{
+  int addr, len, advice;
+  struct proc *curproc = myproc();
+
+  if(argint(0, &addr) < 0 || argint(1, &len) < 0 ||
+     argint(2, &advice) < 0)
+    return -1;
+  if((uint)addr % PGSIZE || len < 0 ||
+     (uint)addr + PGROUNDUP((uint)len) > curproc->sz ||
+     (uint)addr + PGROUNDUP((uint)len) < (uint)addr)
+    return -1;
+  switch(advice){
+  case MADV_NORMAL:
+    return 0;
+  case MADV_DONTNEED:
+    if(uvmrelease(curproc->pgdir, addr, PGROUNDUP(len)) < 0)
+      return -1;
+    lcr3(V2P(curproc->pgdir));
+    return 0;
+  }
+  return -1;
+}
+
+// shmget(key, size): find or create a shared memory segment;
+// returns its id.
+int
+sys_shmget(void)
+{
+  int key, size;
+
+  if(argint(0, &key) < 0 || argint(1, &size) < 0 || size <= 0)
+    return -1;
+  return shmget(key, size);
+}
+
+// shmat(id): map segment id into this process; returns its address.
+int
+sys_shmat(void)
+{
+  int id, addr;
+  uint len;
+  struct shmseg *s;
+
+  if(argint(0, &id) < 0 || (s = shmattach(id, &len)) == 0)
+    return -1;
+  if((addr = shmmap(s, len)) < 0)
+    shmput(s);
+  return addr;
+}
+
+// shmdt(addr): unmap the segment attached at addr.
+int
+sys_shmdt(void)
+{
+  int addr;
+
+  if(argint(0, &addr) < 0)
+    return -1;
+  return shmunmap(addr);
+}
+
+// shmrm(id): remove segment id once nothing has it attached.
+int
+sys_shmrm(void)
+{
+  int id;
+
+  if(argint(0, &id) < 0)
+    return -1;
+  return shmrm(id);
+}
+
+// turn 4 MB superpage heap mappings on or off;
+// returns the previous setting.
+int
+sys_superpages(void)
+{
+  int on, old;
+
+  if(argint(0, &on) < 0)
+    return -1;
+  old = myproc()->superpages;
+  myproc()->superpages = on != 0;
+  return old;
+}
@@ -8,8 +8,6 @@
 #include "traps.h"
 #include "spinlock.h"
 
-int mappages(pde_t *pgdir, void *va, uint size, uint pa, int perm);
-
 // Interrupt descriptor table (shared by all CPUs).
 struct gatedesc idt[256];
 extern uint vectors[];  // in vectors.S: array of 256 entry pointers
@@ -48,10 +46,6 @@ trap(struct trapframe *tf)
     return;
   }
 
-  char *mem;
-  uint a;
-  uint newsz;
-
   switch(tf->trapno){
   case T_IRQ0 + IRQ_TIMER:
     if(cpuid() == 0){
@@ -84,26 +78,15 @@ trap(struct trapframe *tf)
     lapiceoi();
     break;
   case T_PGFLT:
-    newsz = myproc()->sz;
-
-    if(newsz >= KERNBASE)
-      return;
-    if(newsz < rcr2())
-      return;
-
-    a = PGROUNDDOWN(rcr2());
-    mem = kalloc();
-    if(mem == 0){
-      cprintf("allocuvm out of memory\n");
-      return;
-    }
-    memset(mem, 0, PGSIZE);
-    if(mappages(myproc()->pgdir, (char*)a, PGSIZE, V2P(mem), PTE_W|PTE_U) < 0){
-      cprintf("allocuvm out of memory (2)\n");
-      kfree(mem);
-      return;
+    if(myproc() && lazyfault(myproc(), rcr2(), tf->err) == 0){
+      myproc()->npgfault++;
+      break;
     }
-    break;
+    // A bad user address passed to copy_to_user() and friends
+    // makes the copy fail rather than the kernel.
+    if(uaccessfixup(tf))
+      break;
+    // Not a lazy heap fault: fall through.
 
   //PAGEBREAK: 13
   default:
@@ -113,7 +96,6 @@ trap(struct trapframe *tf)
               tf->trapno, cpuid(), tf->eip, rcr2());
       panic("trap");
     }
-    if(tf->trapno == T_PGFLT) return;
     // In user space, assume process misbehaved.
     cprintf("pid %d %s: trap %d err %d on cpu %d "
             "eip 0x%x addr 0x%x--kill proc\n",
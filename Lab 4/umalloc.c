@@ -2,9 +2,18 @@
 #include "stat.h"
 #include "user.h"
 #include "param.h"
+#include "mman.h"
 
 // Memory allocator by Kernighan and Ritchie,
 // The C programming Language, 2nd ed.  Section 8.7.
+//
+// free() hands the pages of large free blocks back to the kernel:
+// a block at the end of the heap shrinks the heap with sbrk(),
+// and the inside of any other block is released with madvise(),
+// to be faulted in afresh when malloc() uses it again.
+
+#define PGSIZE     4096
+#define RELEASEMIN (16*PGSIZE)  // smallest run of pages worth returning
 
 typedef long Align;
 
@@ -21,12 +30,31 @@ typedef union header Header;
 static Header base;
 static Header *freep;
 
-void
-free(void *ap)
+// Return the whole pages inside free block bp to the kernel,
+// keeping the page that holds its header.
+static void
+release(Header *bp)
+{
+  char *start, *end;
+
+  start = (char*)(((uint)(bp + 1) + PGSIZE - 1) & ~(PGSIZE - 1));
+  end = (char*)(bp + bp->s.size);
+  if(end < start + RELEASEMIN)
+    return;
+  if(end == sbrk(0)){
+    if(sbrk(-(end - start)) != (char*)-1)
+      bp->s.size = (Header*)start - bp;
+  } else
+    madvise(start, (uint)end/PGSIZE*PGSIZE - (uint)start, MADV_DONTNEED);
+}
+
+// Put block bp on the free list, merging it with its neighbours.
+// Returns the free block that now holds it.
+static Header*
+insert(Header *bp)
 {
-  Header *bp, *p;
+  Header *p;
 
-  bp = (Header*)ap - 1;
   for(p = freep; !(bp > p && bp < p->s.ptr); p = p->s.ptr)
     if(p >= p->s.ptr && (bp > p || bp < p->s.ptr))
       break;
@@ -38,9 +66,17 @@ free(void *ap)
   if(p + p->s.size == bp){
     p->s.size += bp->s.size;
     p->s.ptr = bp->s.ptr;
+    bp = p;
   } else
     p->s.ptr = bp;
   freep = p;
+  return bp;
+}
+
+void
+free(void *ap)
+{
+  release(insert((Header*)ap - 1));
 }
 
 static Header*
@@ -56,7 +92,7 @@ morecore(uint nu)
     return 0;
   hp = (Header*)p;
   hp->s.size = nu;
-  free((void*)(hp + 1));
+  insert(hp);  // not free(): don't hand it straight back
   return freep;
 }
 
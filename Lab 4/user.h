@@ -1,5 +1,9 @@
 struct stat;
 struct rtcdate;
+struct kmemstat;
+struct slabinfo;
+struct memstat;
+struct fsstat;
 
 // system calls
 int fork(void);
@@ -23,6 +27,22 @@ int getpid(void);
 char* sbrk(int);
 int sleep(int);
 int uptime(void);
+int kmemstat(struct kmemstat*);
+int slabinfo(struct slabinfo*, int);
+int memstat(int, struct memstat*);
+int faultaround(int);
+void* mmap(void*, int, int, int, int, int);
+int munmap(void*, int);
+int superpages(int);
+int madvise(void*, int, int);
+int shmget(int, int);
+void* shmat(int);
+int shmdt(void*);
+int fsstat(struct fsstat*);
+int readahead(int);
+int dropcaches(void);
+int logcrash(int);
+int shmrm(int);
 
 // ulib.c
 int stat(const char*, struct stat*);
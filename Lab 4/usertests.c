@@ -7,6 +7,9 @@
 #include "syscall.h"
 #include "traps.h"
 #include "memlayout.h"
+#include "memstat.h"
+#include "mman.h"
+#include "fsstat.h"
 
 char buf[8192];
 char name[3];
@@ -241,6 +244,111 @@ writetest1(void)
   printf(stdout, "big files ok\n");
 }
 
+// files that need the double-indirect block: write and read back
+// a few megabytes, and report the ticks each took.
+void
+hugefiletest(void)
+{
+  int fd, i, n, t;
+  uint *w;
+
+  printf(stdout, "huge file test\n");
+  fd = open("huge", O_CREATE|O_RDWR);
+  if(fd < 0){
+    printf(stdout, "error: creat huge failed!\n");
+    exit();
+  }
+  w = (uint*)buf;
+  n = 4*1024*1024 / sizeof(buf);
+  t = uptime();
+  for(i = 0; i < n; i++){
+    w[0] = i;
+    w[sizeof(buf)/sizeof(uint) - 1] = ~i;
+    if(write(fd, buf, sizeof(buf)) != sizeof(buf)){
+      printf(stdout, "error: write huge file failed at %d\n", i);
+      exit();
+    }
+  }
+  close(fd);
+  printf(stdout, "wrote %d KB in %d ticks\n", n*sizeof(buf)/1024,
+         uptime() - t);
+
+  fd = open("huge", O_RDONLY);
+  t = uptime();
+  for(i = 0; i < n; i++){
+    if(read(fd, buf, sizeof(buf)) != sizeof(buf)){
+      printf(stdout, "error: read huge file failed at %d\n", i);
+      exit();
+    }
+    if(w[0] != i || w[sizeof(buf)/sizeof(uint) - 1] != ~i){
+      printf(stdout, "error: huge file chunk %d is wrong\n", i);
+      exit();
+    }
+  }
+  if(read(fd, buf, sizeof(buf)) != 0){
+    printf(stdout, "error: huge file too long\n");
+    exit();
+  }
+  close(fd);
+  printf(stdout, "read %d KB in %d ticks\n", n*sizeof(buf)/1024,
+         uptime() - t);
+  if(unlink("huge") < 0){
+    printf(stdout, "unlink huge failed\n");
+    exit();
+  }
+  printf(stdout, "huge file test OK\n");
+}
+
+// two files appended to in turn, a block at a time, read back
+// right: their blocks end up interleaved on disk, so each file
+// needs many runs of blocks.
+void
+interleavetest(void)
+{
+  int fd[2], i, j, k;
+  char *name[2] = { "interleave0", "interleave1" };
+
+  printf(stdout, "interleave test\n");
+  for(k = 0; k < 2; k++){
+    fd[k] = open(name[k], O_CREATE|O_RDWR);
+    if(fd[k] < 0){
+      printf(stdout, "error: creat %s failed!\n", name[k]);
+      exit();
+    }
+  }
+  for(i = 0; i < 300; i++){
+    for(k = 0; k < 2; k++){
+      memset(buf, 0, 512);
+      ((int*)buf)[0] = i;
+      ((int*)buf)[1] = k;
+      if(write(fd[k], buf, 512) != 512){
+        printf(stdout, "error: write %s failed\n", name[k]);
+        exit();
+      }
+    }
+  }
+  for(k = 0; k < 2; k++){
+    close(fd[k]);
+    fd[k] = open(name[k], O_RDONLY);
+    for(i = 0; i < 300; i++){
+      if(read(fd[k], buf, 512) != 512 ||
+         ((int*)buf)[0] != i || ((int*)buf)[1] != k){
+        printf(stdout, "error: %s block %d is wrong\n", name[k], i);
+        exit();
+      }
+      for(j = 8; j < 512; j++){
+        if(buf[j] != 0){
+          printf(stdout, "error: %s block %d is wrong\n", name[k], i);
+          exit();
+        }
+      }
+    }
+    close(fd[k]);
+    unlink(name[k]);
+  }
+  printf(stdout, "interleave test OK\n");
+}
+
 void
 createtest(void)
 {
@@ -354,6 +462,35 @@ pipe1(void)
   printf(1, "pipe1 ok\n");
 }
 
+// several pipes at once, over and over, so that pipes come
+// from the slab cache both new and reused.
+void
+pipereuse(void)
+{
+  int fds[6][2], i, j;
+  char c;
+
+  for(j = 0; j < 20; j++){
+    for(i = 0; i < 6; i++){
+      if(pipe(fds[i]) != 0){
+        printf(1, "pipereuse: pipe() failed\n");
+        exit();
+      }
+    }
+    for(i = 0; i < 6; i++){
+      c = 'a' + i;
+      if(write(fds[i][1], &c, 1) != 1 || read(fds[i][0], &c, 1) != 1 ||
+         c != 'a' + i){
+        printf(1, "pipereuse: wrong data\n");
+        exit();
+      }
+      close(fds[i][0]);
+      close(fds[i][1]);
+    }
+  }
+  printf(1, "pipereuse ok\n");
+}
+
 // meant to be run w/ at most two CPUs
 void
 preempt(void)
@@ -1559,6 +1696,534 @@ validateint(int *p)
       "ebx");
 }
 
+// do lazy read faults share the zero page, and do
+// writes (in parent and child) get private copies?
+void
+zeropagetest(void)
+{
+  struct memstat st0, st1;
+  char *a;
+  int i, pid, sum;
+
+  printf(stdout, "zero page test\n");
+  memstat(0, &st0);
+  a = sbrk(64*4096);
+  sum = 0;
+  for(i = 0; i < 64; i++)
+    sum += a[i*4096];
+  memstat(0, &st1);
+  if(sum != 0 || st1.zeromapped < st0.zeromapped + 64 ||
+     st1.resident != st0.resident){
+    printf(stdout, "zero page test: reads allocated memory\n");
+    exit();
+  }
+
+  pid = fork();
+  if(pid < 0){
+    printf(stdout, "zero page test: fork failed\n");
+    exit();
+  }
+  a[4096] = 'c';
+  if(a[0] != 0 || a[2*4096] != 0 || a[4096] != 'c'){
+    printf(stdout, "zero page test: write leaked\n");
+    exit();
+  }
+  if(pid == 0)
+    exit();
+  wait();
+  memstat(0, &st0);
+  if(st0.zeromapped != st1.zeromapped - 1 || st0.resident != st1.resident + 1){
+    printf(stdout, "zero page test: bad counts after write\n");
+    exit();
+  }
+  printf(stdout, "zero page test OK\n");
+}
+
+// mmap a file shared and private, change both, and check that
+// only the shared changes reach the file after munmap.
+void
+mmaptest(void)
+{
+  char *p, *q;
+  int fd, i, pid;
+
+  printf(stdout, "mmap test\n");
+  fd = open("mmapfile", O_CREATE|O_RDWR);
+  if(fd < 0){
+    printf(stdout, "mmap test: create failed\n");
+    exit();
+  }
+  for(i = 0; i < sizeof(buf); i++)
+    buf[i] = 'a' + i % 26;
+  if(write(fd, buf, sizeof(buf)) != sizeof(buf)){
+    printf(stdout, "mmap test: write failed\n");
+    exit();
+  }
+
+  p = mmap(0, sizeof(buf), PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+  q = mmap(0, sizeof(buf), PROT_READ|PROT_WRITE, MAP_PRIVATE, fd, 0);
+  if(p == (char*)-1 || q == (char*)-1 || p == q){
+    printf(stdout, "mmap test: mmap failed\n");
+    exit();
+  }
+  close(fd);
+  for(i = 0; i < sizeof(buf); i++){
+    if(p[i] != buf[i] || q[i] != buf[i]){
+      printf(stdout, "mmap test: wrong contents\n");
+      exit();
+    }
+  }
+
+  // a child gets a copy of the parent's private changes.
+  q[0] = 'Q';
+  pid = fork();
+  if(pid < 0){
+    printf(stdout, "mmap test: fork failed\n");
+    exit();
+  }
+  if(pid == 0){
+    if(q[0] != 'Q' || q[1] != 'b')
+      printf(stdout, "mmap test: child lost private write\n");
+    q[1] = 'C';
+    exit();
+  }
+  wait();
+  if(q[1] != 'b'){
+    printf(stdout, "mmap test: parent saw child's private write\n");
+    exit();
+  }
+
+  p[0] = 'P';
+  p[5000] = 'P';
+  if(munmap(q, sizeof(buf)) < 0 || munmap(p, sizeof(buf)) < 0){
+    printf(stdout, "mmap test: munmap failed\n");
+    exit();
+  }
+
+  fd = open("mmapfile", O_RDONLY);
+  if(fd < 0 || read(fd, buf, sizeof(buf)) != sizeof(buf)){
+    printf(stdout, "mmap test: reread failed\n");
+    exit();
+  }
+  close(fd);
+  if(buf[0] != 'P' || buf[5000] != 'P' || buf[1] != 'b'){
+    printf(stdout, "mmap test: shared write not written back\n");
+    exit();
+  }
+
+  // anonymous memory is zero-filled.
+  p = mmap(0, 3*4096, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+  if(p == (char*)-1 || p[0] != 0 || p[3*4096-1] != 0){
+    printf(stdout, "mmap test: anonymous mmap failed\n");
+    exit();
+  }
+  p[4096] = 1;
+  pid = fork();
+  if(pid == 0){
+    if(p[4096] != 1 || p[0] != 0)
+      printf(stdout, "mmap test: child lost anonymous memory\n");
+    exit();
+  }
+  wait();
+  munmap(p + 4096, 4096);
+  munmap(p, 3*4096);
+  unlink("mmapfile");
+  printf(stdout, "mmap test OK\n");
+}
+
+// madvise(MADV_DONTNEED) and a shrinking sbrk should give pages
+// back, and the released range should read as zeros afterwards.
+void
+madvisetest(void)
+{
+  struct memstat st0, st1;
+  char *a;
+  int i;
+
+  printf(stdout, "madvise test\n");
+  a = sbrk(64*4096);
+  for(i = 0; i < 64; i++)
+    a[i*4096] = 'x';
+  memstat(0, &st0);
+  if(madvise(a + 16*4096, 32*4096, MADV_DONTNEED) < 0){
+    printf(stdout, "madvise test: madvise failed\n");
+    exit();
+  }
+  memstat(0, &st1);
+  if(st1.resident != st0.resident - 32){
+    printf(stdout, "madvise test: %d pages still resident\n",
+           st1.resident - (st0.resident - 32));
+    exit();
+  }
+  if(a[15*4096] != 'x' || a[16*4096] != 0 || a[47*4096] != 0 ||
+     a[48*4096] != 'x'){
+    printf(stdout, "madvise test: wrong contents\n");
+    exit();
+  }
+  if(madvise(a + 1, 4096, MADV_DONTNEED) >= 0 ||
+     madvise(a, 128*4096, MADV_DONTNEED) >= 0){
+    printf(stdout, "madvise test: bad range accepted\n");
+    exit();
+  }
+
+  memstat(0, &st0);
+  sbrk(-64*4096);
+  memstat(0, &st1);
+  if(st1.resident > st0.resident - 32){
+    printf(stdout, "madvise test: sbrk didn't free pages\n");
+    exit();
+  }
+  printf(stdout, "madvise test OK\n");
+}
+
+// A write into a fresh, 4 MB-aligned stretch of heap should map it
+// with one superpage, and fork should give the child its own copy.
+void
+superpagetest(void)
+{
+  struct memstat st0, st1;
+  char *a;
+  uint sz;
+  int pid;
+
+  printf(stdout, "superpage test\n");
+  pid = fork();
+  if(pid < 0){
+    printf(stdout, "superpage test: fork failed\n");
+    exit();
+  }
+  if(pid > 0){
+    wait();
+    printf(stdout, "superpage test OK\n");
+    return;
+  }
+
+  sz = (uint)sbrk(0);
+  if(sz % (4*1024*1024))
+    sbrk(4*1024*1024 - sz % (4*1024*1024));
+  a = sbrk(4*1024*1024);
+  if(a == (char*)-1){
+    printf(stdout, "superpage test: sbrk failed\n");
+    exit();
+  }
+  memstat(0, &st0);
+  a[0] = 'a';
+  a[4*1024*1024 - 1] = 'z';
+  memstat(0, &st1);
+  if(st1.superpages != st0.superpages + 1 ||
+     st1.resident != st0.resident + 1024 || st1.nfault != st0.nfault + 1){
+    printf(stdout, "superpage test: no superpage (free memory low?)\n");
+    exit();
+  }
+
+  pid = fork();
+  if(pid < 0){
+    printf(stdout, "superpage test: fork failed\n");
+    exit();
+  }
+  if(pid == 0){
+    if(a[0] != 'a' || a[4*1024*1024 - 1] != 'z' || a[4096] != 0){
+      printf(stdout, "superpage test: child sees wrong data\n");
+      exit();
+    }
+    a[0] = 'c';
+    exit();
+  }
+  wait();
+  if(a[0] != 'a'){
+    printf(stdout, "superpage test: child write leaked\n");
+    exit();
+  }
+  exit();
+}
+
+// Two attachments of a shared memory segment, in one process and
+// across fork, should all see the same memory.
+void
+shmtest(void)
+{
+  char *a, *b;
+  int id, pid, fds[2];
+
+  printf(stdout, "shm test\n");
+  if((id = shmget(0, 2*4096)) < 0 || (a = shmat(id)) == (char*)-1 ||
+     (b = shmat(id)) == (char*)-1){
+    printf(stdout, "shm test: shmget/shmat failed\n");
+    exit();
+  }
+  a[4096] = 'a';
+  if(b[4096] != 'a' || b[0] != 0){
+    printf(stdout, "shm test: attachments differ\n");
+    exit();
+  }
+  if(shmdt(b) < 0 || shmdt(b) >= 0){
+    printf(stdout, "shm test: shmdt\n");
+    exit();
+  }
+  pid = fork();
+  if(pid < 0){
+    printf(stdout, "shm test: fork failed\n");
+    exit();
+  }
+  if(pid == 0){
+    a[0] = 'c';
+    exit();
+  }
+  wait();
+  if(a[0] != 'c' || a[4096] != 'a'){
+    printf(stdout, "shm test: child's write not seen\n");
+    exit();
+  }
+  shmdt(a);
+  if(shmat(id) != (char*)-1){
+    printf(stdout, "shm test: segment outlived its attachments\n");
+    exit();
+  }
+
+  // a segment no one attaches goes with shmrm() or its creator.
+  if((id = shmget(0, 4096)) < 0 || shmrm(id) < 0 ||
+     shmat(id) != (char*)-1 || shmrm(id) >= 0){
+    printf(stdout, "shm test: shmrm\n");
+    exit();
+  }
+  if(pipe(fds) < 0){
+    printf(stdout, "shm test: pipe failed\n");
+    exit();
+  }
+  pid = fork();
+  if(pid == 0){
+    id = shmget(0, 4096);
+    write(fds[1], &id, sizeof(id));
+    exit();
+  }
+  wait();
+  close(fds[1]);
+  if(read(fds[0], &id, sizeof(id)) != sizeof(id) || id < 0 ||
+     shmat(id) != (char*)-1){
+    printf(stdout, "shm test: segment outlived its creator\n");
+    exit();
+  }
+  close(fds[0]);
+  printf(stdout, "shm test OK\n");
+}
+
+// System calls that copy results out should fault in lazily
+// allocated memory, and fail cleanly on memory that isn't there.
+void
+uaccesstest(void)
+{
+  char *a;
+  int *fds, fd;
+  struct stat *st;
+
+  printf(stdout, "uaccess test\n");
+  a = sbrk(2*4096);
+  fds = (int*)(a + 4096 - 4);  // straddles two untouched pages
+  if(pipe(fds) < 0){
+    printf(stdout, "uaccess test: pipe into lazy memory failed\n");
+    exit();
+  }
+  close(fds[0]);
+  close(fds[1]);
+  fd = open(".", 0);
+  st = (struct stat*)(a + 100);
+  if(fstat(fd, st) < 0 || st->type != T_DIR){
+    printf(stdout, "uaccess test: fstat into lazy memory failed\n");
+    exit();
+  }
+  if(pipe((int*)(sbrk(0) + 64*4096)) >= 0 ||
+     fstat(fd, (struct stat*)(sbrk(0) + 64*4096)) >= 0 ||
+     pipe((int*)0x80000000) >= 0){
+    printf(stdout, "uaccess test: bad pointer accepted\n");
+    exit();
+  }
+  close(fd);
+  sbrk(-2*4096);
+  printf(stdout, "uaccess test OK\n");
+}
+
+// a file that fits in the buffer cache is read back from it.
+void
+bcachetest(void)
+{
+  struct fsstat st0, st1;
+  char buf[512];
+  int fd, i;
+
+  printf(stdout, "bcache test\n");
+  fd = open("bcache", O_CREATE|O_RDWR);
+  for(i = 0; i < 8; i++)
+    write(fd, buf, sizeof(buf));
+  close(fd);
+  if(fsstat(&st0) < 0){
+    printf(stdout, "bcache test: fsstat failed\n");
+    exit();
+  }
+  fd = open("bcache", O_RDONLY);
+  while(read(fd, buf, sizeof(buf)) > 0)
+    ;
+  close(fd);
+  fsstat(&st1);
+  if(st1.nhit - st0.nhit < 8 || st1.nbuf < NBUF || st1.nbuf > st1.maxbuf){
+    printf(stdout, "bcache test: %d hits, %d of %d buffers\n",
+           st1.nhit - st0.nhit, st1.nbuf, st1.maxbuf);
+    exit();
+  }
+  unlink("bcache");
+  printf(stdout, "bcache test OK\n");
+}
+
+// a sequential read from a cold cache reads ahead, and the blocks
+// read ahead hold the right data.
+void
+readaheadtest(void)
+{
+  struct fsstat st0, st1;
+  char buf[512];
+  int fd, i, j;
+
+  printf(stdout, "readahead test\n");
+  fd = open("readahead", O_CREATE|O_RDWR);
+  for(i = 0; i < 32; i++){
+    memset(buf, i, sizeof(buf));
+    write(fd, buf, sizeof(buf));
+  }
+  close(fd);
+  dropcaches();
+  fsstat(&st0);
+  fd = open("readahead", O_RDONLY);
+  for(i = 0; i < 32; i++){
+    if(read(fd, buf, sizeof(buf)) != sizeof(buf)){
+      printf(stdout, "readahead test: short read\n");
+      exit();
+    }
+    for(j = 0; j < sizeof(buf); j++){
+      if(buf[j] != i){
+        printf(stdout, "readahead test: wrong data in block %d\n", i);
+        exit();
+      }
+    }
+  }
+  close(fd);
+  fsstat(&st1);
+  if(st1.nreadahead == st0.nreadahead){
+    printf(stdout, "readahead test: nothing read ahead\n");
+    exit();
+  }
+  unlink("readahead");
+  printf(stdout, "readahead test OK\n");
+}
+
+// the free block count goes down as a file grows and back up
+// once it is deleted.
+void
+freeblocktest(void)
+{
+  struct fsstat st0, st1, st2;
+  int fd;
+
+  printf(stdout, "free block test\n");
+  fsstat(&st0);
+  fd = open("freeblock", O_CREATE|O_RDWR);
+  if(write(fd, buf, 20*512) != 20*512){
+    printf(stdout, "free block test: write failed\n");
+    exit();
+  }
+  close(fd);
+  fsstat(&st1);
+  unlink("freeblock");
+  fsstat(&st2);
+  if(st1.nfreeblock > st0.nfreeblock - 20 ||
+     st2.nfreeblock != st0.nfreeblock){
+    printf(stdout, "free block test: %d free, %d with the file, %d after\n",
+           st0.nfreeblock, st1.nfreeblock, st2.nfreeblock);
+    exit();
+  }
+  printf(stdout, "free block test OK\n");
+}
+
+// a file's inode stays cached after its last close, so opening
+// it again finds it in the inode cache.
+void
+icachetest(void)
+{
+  struct fsstat st0, st1;
+  int fd, i;
+
+  printf(stdout, "icache test\n");
+  fd = open("icache", O_CREATE|O_RDWR);
+  close(fd);
+  fsstat(&st0);
+  for(i = 0; i < 20; i++){
+    if((fd = open("icache", O_RDONLY)) < 0){
+      printf(stdout, "icache test: open failed\n");
+      exit();
+    }
+    close(fd);
+  }
+  fsstat(&st1);
+  if(st1.nihit - st0.nihit < 20 || st1.ninode < NINODE ||
+     st1.ninode > st1.maxinode){
+    printf(stdout, "icache test: %d hits, %d of %d inodes\n",
+           st1.nihit - st0.nihit, st1.ninode, st1.maxinode);
+    exit();
+  }
+  unlink("icache");
+  printf(stdout, "icache test OK\n");
+}
+
+// large writes send file data home without logging it, and a
+// later overwrite in the middle of a block keeps the rest.
+void
+orderedtest(void)
+{
+  struct fsstat st0, st1;
+  int fd, i, j;
+
+  printf(stdout, "ordered test\n");
+  fsstat(&st0);
+  fd = open("ordered", O_CREATE|O_RDWR);
+  for(i = 0; i < 64; i += 16){
+    for(j = 0; j < 16; j++)
+      memset(buf + j*512, i + j, 512);
+    if(write(fd, buf, 16*512) != 16*512){
+      printf(stdout, "ordered test: write failed\n");
+      exit();
+    }
+  }
+  close(fd);
+  fsstat(&st1);
+  if(st1.ndatawrite - st0.ndatawrite < 64 ||
+     st1.nlogwrite - st0.nlogwrite >= 64){
+    printf(stdout, "ordered test: file data was logged\n");
+    exit();
+  }
+
+  fd = open("ordered", O_RDWR);
+  memset(buf, 0xaa, 100);
+  if(read(fd, buf + 100, 300) != 300 || write(fd, buf, 100) != 100){
+    printf(stdout, "ordered test: overwrite failed\n");
+    exit();
+  }
+  close(fd);
+  fd = open("ordered", O_RDONLY);
+  for(i = 0; i < 64; i++){
+    if(read(fd, buf, 512) != 512){
+      printf(stdout, "ordered test: short read\n");
+      exit();
+    }
+    for(j = 0; j < 512; j++){
+      if(buf[j] != (i == 0 && j >= 300 && j < 400 ? (char)0xaa : i)){
+        printf(stdout, "ordered test: wrong data in block %d\n", i);
+        exit();
+      }
+    }
+  }
+  close(fd);
+  unlink("ordered");
+  printf(stdout, "ordered test OK\n");
+}
+
 void
 validatetest(void)
 {
@@ -1768,12 +2433,25 @@ main(int argc, char *argv[])
   bigargtest();
   bsstest();
   sbrktest();
+  zeropagetest();
+  mmaptest();
+  superpagetest();
+  madvisetest();
+  uaccesstest();
+  shmtest();
   validatetest();
 
   opentest();
   writetest();
   writetest1();
+  hugefiletest();
+  interleavetest();
   createtest();
+  bcachetest();
+  readaheadtest();
+  orderedtest();
+  freeblocktest();
+  icachetest();
 
   openiputtest();
   exitiputtest();
@@ -1781,6 +2459,7 @@ main(int argc, char *argv[])
 
   mem();
   pipe1();
+  pipereuse();
   preempt();
   exitwait();
 
@@ -5,10 +5,20 @@
 #include "memlayout.h"
 #include "mmu.h"
 #include "proc.h"
+#include "spinlock.h"
 #include "elf.h"
+#include "memstat.h"
 
 extern char data[];  // defined by kernel.ld
 pde_t *kpgdir;  // for use in scheduler()
+static char *zeropage;  // shared read-only page of zeros
+
+// Page directories freed by freevm() while some CPU still had
+// them loaded, linked through their first entry.
+struct {
+  struct spinlock lock;
+  pde_t *list;
+} deadpgdirs;
 
 // Set up CPU's kernel segment descriptors.
 // Run once on entry on each CPU.
@@ -32,7 +42,9 @@ seginit(void)
 // Return the address of the PTE in page table pgdir
 // that corresponds to virtual address va.  If alloc!=0,
 // create any required page table pages.
-static pte_t *
+// If va is in a 4 MB superpage, return the PDE that maps it;
+// callers that need the 4 KB page must check for PTE_PS.
+pte_t *
 walkpgdir(pde_t *pgdir, const void *va, int alloc)
 {
   pde_t *pde;
@@ -40,12 +52,13 @@ walkpgdir(pde_t *pgdir, const void *va, int alloc)
 
   pde = &pgdir[PDX(va)];
   if(*pde & PTE_P){
+    if(*pde & PTE_PS)
+      return pde;
     pgtab = (pte_t*)P2V(PTE_ADDR(*pde));
   } else {
-    if(!alloc || (pgtab = (pte_t*)kalloc()) == 0)
-      return 0;
     // Make sure all those PTE_P bits are zero.
-    memset(pgtab, 0, PGSIZE);
+    if(!alloc || (pgtab = (pte_t*)kalloc_zeroed()) == 0)
+      return 0;
     // The permissions here are overly generous, but they can
     // be further restricted by the permissions in the page table
     // entries, if necessary.
@@ -79,6 +92,43 @@ mappages(pde_t *pgdir, void *va, uint size, uint pa, int perm)
   return 0;
 }
 
+// Map the 4 MB-aligned range at va with one superpage, if a free
+// 4 MB block is available and nothing in the range is mapped yet.
+// Returns 0 on success, -1 if the caller should use 4 KB pages.
+static int
+mapsuper(pde_t *pgdir, uint va)
+{
+  pde_t *pde;
+  char *mem;
+
+  pde = &pgdir[PDX(va)];
+  if(*pde & PTE_P)
+    return -1;
+  // Don't take memory that paging out is about to need.
+  if(kfreepages() < NPTENTRIES + SWAPHIGH)
+    return -1;
+  if((mem = kalloc_order(SPGORDER)) == 0)
+    return -1;
+  memset(mem, 0, SPGSIZE);
+  *pde = V2P(mem) | PTE_PS | PTE_P | PTE_W | PTE_U;
+  return 0;
+}
+
+// Break the superpage mapped by *pde into 4 KB PTEs held in
+// page table page pgtab.
+static void
+splitsuper(pde_t *pde, pte_t *pgtab)
+{
+  uint pa, perm;
+  int i;
+
+  pa = PTE_ADDR(*pde);
+  perm = PTE_FLAGS(*pde) & ~PTE_PS;
+  for(i = 0; i < NPTENTRIES; i++)
+    pgtab[i] = (pa + i*PGSIZE) | perm;
+  *pde = V2P(pgtab) | PTE_P | PTE_W | PTE_U;
+}
+
 // There is one page table per process, plus one that's used when
 // a CPU is not running any process (kpgdir). The kernel uses the
 // current process's page table during system calls and interrupts;
@@ -114,21 +164,22 @@ static struct kmap {
  { (void*)DEVSPACE, DEVSPACE,      0,         PTE_W}, // more devices
 };
 
-// Set up kernel part of a page table.
+// Set up kernel part of a page table.  The kernel's mappings are
+// the same in every page table, so they are marked global (PTE_G)
+// and survive %cr3 loads.
 pde_t*
 setupkvm(void)
 {
   pde_t *pgdir;
   struct kmap *k;
 
-  if((pgdir = (pde_t*)kalloc()) == 0)
+  if((pgdir = (pde_t*)kalloc_zeroed()) == 0)
     return 0;
-  memset(pgdir, 0, PGSIZE);
   if (P2V(PHYSTOP) > (void*)DEVSPACE)
     panic("PHYSTOP too high");
   for(k = kmap; k < &kmap[NELEM(kmap)]; k++)
     if(mappages(pgdir, k->virt, k->phys_end - k->phys_start,
-                (uint)k->phys_start, k->perm) < 0) {
+                (uint)k->phys_start, k->perm | PTE_G) < 0) {
       freevm(pgdir);
       return 0;
     }
@@ -140,19 +191,69 @@ setupkvm(void)
 void
 kvmalloc(void)
 {
+  initlock(&deadpgdirs.lock, "deadpgdirs");
   kpgdir = setupkvm();
-  switchkvm();
+  lcr3(V2P(kpgdir));  // no mycpu() yet; see switchkvm()
+  if((zeropage = kalloc()) == 0)
+    panic("kvmalloc: zeropage");
+  memset(zeropage, 0, PGSIZE);
+}
+
+// Load pgdir into %cr3 and note it in this CPU's state.  If that
+// was the last CPU holding a page directory that freevm() had to
+// leave behind, free it now.  Caller must have interrupts off.
+static void
+loadpgdir(pde_t *pgdir)
+{
+  lcr3(V2P(pgdir));
+  xchg((volatile uint*)&mycpu()->pgdir, (uint)pgdir);
+  if(deadpgdirs.list)
+    reappgdirs();
 }
 
-// Switch h/w page table register to the kernel-only page table,
-// for when no process is running.
+// Switch h/w page table register to the kernel-only page table.
 void
 switchkvm(void)
 {
-  lcr3(V2P(kpgdir));   // switch to the kernel page table
+  pushcli();
+  loadpgdir(kpgdir);   // switch to the kernel page table
+  popcli();
+}
+
+// Called by the scheduler between processes.  It keeps the last
+// process's page table loaded, rather than switching to kpgdir,
+// unless that page table has since been freed.
+void
+idleuvm(void)
+{
+  pde_t *d;
+
+  if(deadpgdirs.list == 0)
+    return;
+  acquire(&deadpgdirs.lock);
+  for(d = deadpgdirs.list; d; d = (pde_t*)d[0])
+    if(d == mycpu()->pgdir)
+      break;
+  release(&deadpgdirs.lock);
+  if(d)
+    switchkvm();
+}
+
+// Switch to process p's address space in the scheduler.  If this
+// CPU already has p's page table loaded, and p has not run
+// elsewhere or had its mappings changed by another process since
+// (see swapvictim()), its TLB entries are still good: skip the
+// %cr3 load, and the TSS, which still points at p's kernel stack.
+void
+resumeuvm(struct proc *p)
+{
+  if(mycpu()->pgdir == p->pgdir && p->tlbcpu == mycpu())
+    return;
+  switchuvm(p);
 }
 
 // Switch TSS and h/w page table to correspond to process p.
+// This always loads %cr3, so it also flushes p's TLB entries.
 void
 switchuvm(struct proc *p)
 {
@@ -173,7 +274,8 @@ switchuvm(struct proc *p)
   // forbids I/O instructions (e.g., inb and outb) from user space
   mycpu()->ts.iomb = (ushort) 0xFFFF;
   ltr(SEG_TSS << 3);
-  lcr3(V2P(p->pgdir));  // switch to process's address space
+  loadpgdir(p->pgdir);  // switch to process's address space
+  p->tlbcpu = mycpu();
   popcli();
 }
 
@@ -231,13 +333,17 @@ allocuvm(pde_t *pgdir, uint oldsz, uint newsz)
 
   a = PGROUNDUP(oldsz);
   for(; a < newsz; a += PGSIZE){
-    mem = kalloc();
+    if(a % SPGSIZE == 0 && newsz - a >= SPGSIZE &&
+       mapsuper(pgdir, a) == 0){
+      a += SPGSIZE - PGSIZE;
+      continue;
+    }
+    mem = kallocswap_zeroed();
     if(mem == 0){
       cprintf("allocuvm out of memory\n");
       deallocuvm(pgdir, newsz, oldsz);
       return 0;
     }
-    memset(mem, 0, PGSIZE);
     if(mappages(pgdir, (char*)a, PGSIZE, V2P(mem), PTE_W|PTE_U) < 0){
       cprintf("allocuvm out of memory (2)\n");
       deallocuvm(pgdir, newsz, oldsz);
@@ -255,7 +361,8 @@ allocuvm(pde_t *pgdir, uint oldsz, uint newsz)
 int
 deallocuvm(pde_t *pgdir, uint oldsz, uint newsz)
 {
-  pte_t *pte;
+  pde_t *pde;
+  pte_t *pte, *pgtab;
   uint a, pa;
 
   if(newsz >= oldsz)
@@ -263,6 +370,23 @@ deallocuvm(pde_t *pgdir, uint oldsz, uint newsz)
 
   a = PGROUNDUP(newsz);
   for(; a  < oldsz; a += PGSIZE){
+    pde = &pgdir[PDX(a)];
+    if((*pde & (PTE_P|PTE_PS)) == (PTE_P|PTE_PS)){
+      if(a % SPGSIZE == 0 && oldsz - a >= SPGSIZE){
+        kfree_order(P2V(PTE_ADDR(*pde)), SPGORDER);
+        *pde = 0;
+        a += SPGSIZE - PGSIZE;
+        continue;
+      }
+      // Freeing only the top of a superpage.  Split it, using its
+      // last 4 KB page, which is being freed anyway, as the page
+      // table for what stays mapped.
+      if(oldsz < SPGROUNDDOWN(a) + SPGSIZE)
+        panic("deallocuvm: superpage");
+      pgtab = (pte_t*)((char*)P2V(PTE_ADDR(*pde)) + SPGSIZE - PGSIZE);
+      splitsuper(pde, pgtab);
+      pgtab[NPTENTRIES-1] = 0;
+    }
     pte = walkpgdir(pgdir, (char*)a, 0);
     if(!pte)
       a = PGADDR(PDX(a) + 1, 0, 0) - PGSIZE;
@@ -270,16 +394,103 @@ deallocuvm(pde_t *pgdir, uint oldsz, uint newsz)
       pa = PTE_ADDR(*pte);
       if(pa == 0)
         panic("kfree");
-      char *v = P2V(pa);
-      kfree(v);
+      if(pa != V2P(zeropage))
+        kfree(P2V(pa));
+      *pte = 0;
+    } else if(*pte & PTE_SWAP){
+      swapfree(*pte);
       *pte = 0;
     }
   }
   return newsz;
 }
 
+// Split the superpage covering va, if there is one, into
+// 4 KB pages.  Returns -1 if there is no memory for the page table.
+static int
+unsuper(pde_t *pgdir, uint va)
+{
+  pde_t *pde;
+  pte_t *pgtab;
+
+  pde = &pgdir[PDX(va)];
+  if((*pde & (PTE_P|PTE_PS)) != (PTE_P|PTE_PS))
+    return 0;
+  if((pgtab = (pte_t*)kalloc()) == 0)
+    return -1;
+  splitsuper(pde, pgtab);
+  return 0;
+}
+
+// Free the pages of the page-aligned range [va, va+n), leaving
+// it to fault in again like memory that was never touched: heap
+// pages come back zeroed, executable pages are read in again.
+// Superpages straddling either end are split first.
+// The caller must flush the TLB.  Returns -1 if out of memory,
+// in which case nothing has been freed.
+int
+uvmrelease(pde_t *pgdir, uint va, uint n)
+{
+  if((va % SPGSIZE && unsuper(pgdir, va) < 0) ||
+     ((va + n) % SPGSIZE && unsuper(pgdir, va + n) < 0))
+    return -1;
+  deallocuvm(pgdir, va + n, va);
+  return 0;
+}
+
+// Is pgdir loaded on any CPU?
+static int
+pgdirloaded(pde_t *pgdir)
+{
+  int i;
+
+  for(i = 0; i < ncpu; i++)
+    if(cpus[i].pgdir == pgdir)
+      return 1;
+  return 0;
+}
+
+// Free a page directory and its remaining page table pages.
+static void
+freepgdir(pde_t *pgdir)
+{
+  uint i;
+
+  for(i = 0; i < NPDENTRIES; i++){
+    if(pgdir[i] & PTE_P){
+      char * v = P2V(PTE_ADDR(pgdir[i]));
+      kfree(v);
+    }
+  }
+  kfree((char*)pgdir);
+}
+
+// Free the dead page directories that no CPU has loaded any more.
+void
+reappgdirs(void)
+{
+  pde_t **pp, *d;
+
+  acquire(&deadpgdirs.lock);
+  for(pp = &deadpgdirs.list; (d = *pp) != 0; ){
+    if(pgdirloaded(d)){
+      pp = (pde_t**)&d[0];
+      continue;
+    }
+    *pp = (pde_t*)d[0];
+    d[0] = 0;
+    freepgdir(d);
+  }
+  release(&deadpgdirs.lock);
+}
+
 // Free a page table and all the physical memory pages
-// in the user part.
+// in the user part.  The scheduler leaves a process's page
+// table loaded after it stops running, so another CPU may still
+// have pgdir in %cr3.  That CPU only uses the kernel's mappings,
+// so the user part goes now; the directory itself and the
+// kernel's page tables wait on deadpgdirs until loadpgdir() on
+// the last CPU holding it moves on.
 void
 freevm(pde_t *pgdir)
 {
@@ -288,13 +499,19 @@ freevm(pde_t *pgdir)
   if(pgdir == 0)
     panic("freevm: no pgdir");
   deallocuvm(pgdir, KERNBASE, 0);
-  for(i = 0; i < NPDENTRIES; i++){
+  for(i = 0; i < PDX(KERNBASE); i++){
     if(pgdir[i] & PTE_P){
-      char * v = P2V(PTE_ADDR(pgdir[i]));
-      kfree(v);
+      kfree(P2V(PTE_ADDR(pgdir[i])));
+      pgdir[i] = 0;
     }
   }
-  kfree((char*)pgdir);
+
+  acquire(&deadpgdirs.lock);
+  pgdir[0] = (pde_t)deadpgdirs.list;  // page aligned, so not PTE_P
+  deadpgdirs.list = pgdir;
+  __sync_synchronize();  // pairs with the xchg in loadpgdir()
+  release(&deadpgdirs.lock);
+  reappgdirs();
 }
 
 // Clear PTE_U on a page. Used to create an inaccessible
@@ -323,15 +540,49 @@ copyuvm(pde_t *pgdir, uint sz)
   if((d = setupkvm()) == 0)
     return 0;
   for(i = 0; i < sz; i += PGSIZE){
-    if((pte = walkpgdir(pgdir, (void *) i, 0)) == 0)
-      panic("copyuvm: pte should exist");
-    if(!(*pte & PTE_P))
-      panic("copyuvm: page not present");
-    pa = PTE_ADDR(*pte);
-    flags = PTE_FLAGS(*pte);
-    if((mem = kalloc()) == 0)
+    if((pgdir[PDX(i)] & (PTE_P|PTE_PS)) == (PTE_P|PTE_PS)){
+      // A superpage: copy it whole if we can, else 4 KB at a time.
+      if((mem = kalloc_order(SPGORDER)) != 0){
+        memmove(mem, P2V(PTE_ADDR(pgdir[PDX(i)])), SPGSIZE);
+        d[PDX(i)] = V2P(mem) | PTE_FLAGS(pgdir[PDX(i)]);
+        i += SPGSIZE - PGSIZE;
+        continue;
+      }
+      if((mem = kallocswap()) == 0)
+        goto bad;
+      memmove(mem, (char*)P2V(PTE_ADDR(pgdir[PDX(i)])) + (i % SPGSIZE), PGSIZE);
+      if(mappages(d, (void*)i, PGSIZE, V2P(mem), PTE_W|PTE_U) < 0){
+        kfree(mem);
+        goto bad;
+      }
+      continue;
+    }
+    // The heap is allocated lazily, so parts of it
+    // may not be mapped yet; the child faults them in.
+    if((pte = walkpgdir(pgdir, (void *) i, 0)) == 0){
+      i = PGADDR(PDX(i) + 1, 0, 0) - PGSIZE;
+      continue;
+    }
+    if(!(*pte & (PTE_P|PTE_SWAP)))
+      continue;
+    if((*pte & PTE_P) && PTE_ADDR(*pte) == V2P(zeropage)){
+      // Still all zeros: share it.
+      if(mappages(d, (void*)i, PGSIZE, PTE_ADDR(*pte), PTE_FLAGS(*pte)) < 0)
+        goto bad;
+      continue;
+    }
+    // Allocate before looking at *pte: kallocswap() may sleep.
+    // (Our own pages stay put while we are in a system call.)
+    if((mem = kallocswap()) == 0)
       goto bad;
-    memmove(mem, (char*)P2V(pa), PGSIZE);
+    if(*pte & PTE_SWAP){
+      swapread(*pte, mem);
+      flags = (PTE_FLAGS(*pte) & (PTE_W|PTE_U)) | PTE_P;
+    } else {
+      pa = PTE_ADDR(*pte);
+      flags = PTE_FLAGS(*pte);
+      memmove(mem, (char*)P2V(pa), PGSIZE);
+    }
     if(mappages(d, (void*)i, PGSIZE, V2P(mem), flags) < 0) {
       kfree(mem);
       goto bad;
@@ -344,6 +595,261 @@ bad:
   return 0;
 }
 
+// Return the executable segment of p containing va, or 0.
+static struct seg*
+findseg(struct proc *p, uint va)
+{
+  struct seg *s;
+
+  for(s = p->seg; s < &p->seg[p->nseg]; s++)
+    if(va >= s->va && va - s->va < s->memsz)
+      return s;
+  return 0;
+}
+
+// Read page a of segment s in from p's executable and map it.
+static int
+execfault(struct proc *p, struct seg *s, uint a)
+{
+  char *mem;
+  uint n;
+
+  if((mem = kallocswap()) == 0){
+    cprintf("lazyfault: out of memory\n");
+    return -1;
+  }
+  n = 0;
+  if(a - s->va < s->filesz){
+    n = s->filesz - (a - s->va);
+    if(n > PGSIZE)
+      n = PGSIZE;
+    ilock(p->exe);
+    if(readi(p->exe, mem, s->off + (a - s->va), n) != n){
+      iunlock(p->exe);
+      kfree(mem);
+      return -1;
+    }
+    iunlock(p->exe);
+  }
+  memset(mem + n, 0, PGSIZE - n);
+  if(mappages(p->pgdir, (char*)a, PGSIZE, V2P(mem), PTE_W|PTE_U) < 0){
+    cprintf("lazyfault: out of memory (2)\n");
+    kfree(mem);
+    return -1;
+  }
+  p->nexecfault++;
+  if(n > 0)
+    p->nmajfault++;
+  return 0;
+}
+
+// Can the 4 MB range around heap address va be one superpage?
+// It must lie wholly below p->sz and hold no executable segment.
+static int
+superok(struct proc *p, uint va)
+{
+  struct seg *s;
+  uint a;
+
+  a = SPGROUNDDOWN(va);
+  if(a + SPGSIZE > p->sz || a + SPGSIZE < a)
+    return 0;
+  for(s = p->seg; s < &p->seg[p->nseg]; s++)
+    if(s->va < a + SPGSIZE && a < s->va + s->memsz)
+      return 0;
+  return 1;
+}
+
+// Make every page of [va, va+n) below p->sz present, private
+// and writable.  argptr() calls this before a system call uses a
+// buffer, so that the kernel never faults on it later, perhaps
+// while holding a spinlock (pipes, the console) or another inode's
+// lock.  The pages cannot be paged out again until the system call
+// returns; see swapvictim().
+int
+uvmprefault(struct proc *p, uint va, uint n)
+{
+  pte_t *pte;
+  uint a;
+
+  for(a = PGROUNDDOWN(va); a < va + n; a += PGSIZE){
+    pte = walkpgdir(p->pgdir, (char*)a, 0);
+    if(pte && (*pte & PTE_P) && (*pte & PTE_W) &&
+       PTE_ADDR(*pte) != V2P(zeropage))
+      continue;
+    if(lazyfault(p, a, FEC_WR) < 0)
+      return -1;
+    p->npgfault++;
+  }
+  return 0;
+}
+
+// Handle a page fault at va in p's lazily allocated memory.
+// Pages of the executable's segments are read in from p->exe.
+// Otherwise va is in the heap: a read fault maps the shared zero
+// page read-only; a write fault, or a write to the zero page, maps
+// a private zeroed page.  If p has been faulting on consecutive
+// heap pages, map a window of pages past va as well, doubling the
+// window on each sequential fault up to p->famax.
+// Pages that were paged out are read back in from swap.
+// A write fault in a 4 MB-aligned range of heap that is wholly
+// below p->sz and not mapped at all yet maps the whole range with
+// one superpage instead, if p->superpages is set.
+// Faults above p->sz are passed on to mmapfault().
+// err is the page fault error code.
+// Returns 0 if the fault was resolved, -1 if va is not a lazily
+// allocated address.
+int
+lazyfault(struct proc *p, uint va, int err)
+{
+  char *mem;
+  uint a, i;
+  int write;
+  pte_t *pte;
+  struct seg *s;
+
+  if(va >= KERNBASE)
+    return -1;
+  if(va >= p->sz)
+    return mmapfault(p, va, err);
+  write = err & FEC_WR;
+  a = PGROUNDDOWN(va);
+  pte = walkpgdir(p->pgdir, (char*)a, 0);
+  if(pte && (*pte & PTE_SWAP))
+    return swapin(p, a);
+  if(pte && (*pte & PTE_P)){
+    if(!write || PTE_ADDR(*pte) != V2P(zeropage))
+      return -1;  // protection fault, e.g. the stack guard page
+    // First write to a zero page: give it a private copy.
+    if((mem = kallocswap_zeroed()) == 0){
+      cprintf("lazyfault: out of memory\n");
+      return -1;
+    }
+    *pte = V2P(mem) | PTE_P | PTE_W | PTE_U;
+    p->nfault++;
+    lcr3(V2P(p->pgdir));  // flush the stale read-only TLB entry
+    return 0;
+  }
+  if((s = findseg(p, a)) != 0)
+    return execfault(p, s, a);
+
+  p->nfault++;
+  if(write && p->superpages && superok(p, a) &&
+     mapsuper(p->pgdir, SPGROUNDDOWN(a)) == 0)
+    return 0;
+  if(a == p->lastfault + PGSIZE)
+    p->fawin *= 2;  // still sequential: grow the window
+  else
+    p->fawin = 1;
+  if(p->fawin > p->famax)
+    p->fawin = p->famax;
+
+  for(i = 0; i < p->fawin && a < p->sz; i++, a += PGSIZE){
+    if(i > 0 && (pte = walkpgdir(p->pgdir, (char*)a, 0)) != 0 &&
+       (*pte & (PTE_P|PTE_SWAP)))
+      break;
+    if(!write){
+      if(mappages(p->pgdir, (char*)a, PGSIZE, V2P(zeropage), PTE_U) < 0){
+        if(i > 0)
+          break;
+        cprintf("lazyfault: out of memory (2)\n");
+        return -1;
+      }
+    } else {
+      if((mem = kallocswap_zeroed()) == 0){
+        if(i > 0)
+          break;
+        cprintf("lazyfault: out of memory\n");
+        return -1;
+      }
+      // Mark the faulting page accessed, so that paging out to
+      // make room for the rest of the window doesn't pick it.
+      if(mappages(p->pgdir, (char*)a, PGSIZE, V2P(mem),
+                  PTE_W|PTE_U|(i == 0 ? PTE_A : 0)) < 0){
+        kfree(mem);
+        if(i > 0)
+          break;
+        cprintf("lazyfault: out of memory (2)\n");
+        return -1;
+      }
+    }
+    if(i > 0)
+      p->nprefault++;
+    p->lastfault = a;
+  }
+  return 0;
+}
+
+// Count the user pages mapped by pgdir, mmap() regions included,
+// into st: resident pages backed by private memory (each superpage
+// counts as NPTENTRIES of them), pages mapping the zero page, pages
+// paged out to swap, superpages, and page table pages, counting
+// the page directory itself.
+void
+uvmcount(pde_t *pgdir, struct memstat *st)
+{
+  pte_t *pgtab;
+  uint i, j;
+
+  st->resident = st->zeromapped = st->swapped = st->superpages = 0;
+  st->pgtables = 1;
+  for(i = 0; i < PDX(KERNBASE); i++){
+    if(!(pgdir[i] & PTE_P))
+      continue;
+    if(pgdir[i] & PTE_PS){
+      st->superpages++;
+      st->resident += NPTENTRIES;
+      continue;
+    }
+    st->pgtables++;
+    pgtab = (pte_t*)P2V(PTE_ADDR(pgdir[i]));
+    for(j = 0; j < NPTENTRIES; j++){
+      if(pgtab[j] & PTE_SWAP)
+        st->swapped++;
+      else if(!(pgtab[j] & PTE_P))
+        continue;
+      else if(PTE_ADDR(pgtab[j]) == V2P(zeropage))
+        st->zeromapped++;
+      else
+        st->resident++;
+    }
+  }
+}
+
+// Advance the clock hand *va over pgdir's user pages below sz,
+// clearing accessed bits as it goes.  At the first private page
+// whose accessed bit was already clear, make its PTE the swapped-out
+// entry swpte and return the page's kernel address.  Returns 0,
+// with *va at or past sz, if there is no such page.
+// Superpages are skipped: they are never paged out.
+char*
+clockscan(pde_t *pgdir, uint sz, uint *va, uint swpte)
+{
+  pte_t *pte;
+  uint a, pa;
+
+  for(a = *va; a < sz; a += PGSIZE){
+    if((pte = walkpgdir(pgdir, (char*)a, 0)) == 0 || (*pte & PTE_PS)){
+      a = PGADDR(PDX(a) + 1, 0, 0) - PGSIZE;
+      continue;
+    }
+    if((*pte & (PTE_P|PTE_U)) != (PTE_P|PTE_U))
+      continue;
+    pa = PTE_ADDR(*pte);
+    if(pa == V2P(zeropage))
+      continue;
+    if(*pte & PTE_A){
+      *pte &= ~PTE_A;  // second chance
+      continue;
+    }
+    *pte = swpte | (*pte & (PTE_W|PTE_U));
+    *va = a + PGSIZE;
+    return P2V(pa);
+  }
+  *va = a;
+  return 0;
+}
+
 //PAGEBREAK!
 // Map user virtual address to kernel address.
 char*
@@ -385,6 +891,51 @@ copyout(pde_t *pgdir, uint va, void *p, uint len)
   return 0;
 }
 
+// Copy len bytes from p to user address va in the current
+// process, faulting pages in as needed.
+// Returns -1 if some of [va, va+len) is not valid user memory.
+int
+copy_to_user(uint va, void *p, uint len)
+{
+  if(va >= KERNBASE || len > KERNBASE - va)
+    return -1;
+  return copy_user((void*)va, p, len);
+}
+
+// Copy len bytes from user address va in the current process to p.
+int
+copy_from_user(void *p, uint va, uint len)
+{
+  if(va >= KERNBASE || len > KERNBASE - va)
+    return -1;
+  return copy_user(p, (void*)va, len);
+}
+
+struct extable {
+  uint insn;
+  uint fixup;
+};
+extern struct extable __extable_start[], __extable_end[];
+
+// If tf is a kernel-mode fault at one of the instructions in
+// uaccess.S that touch user memory, resume at its fixup and
+// return 1.  Otherwise return 0.
+int
+uaccessfixup(struct trapframe *tf)
+{
+  struct extable *e;
+
+  if(tf->cs & 3)
+    return 0;
+  for(e = __extable_start; e < __extable_end; e++){
+    if(e->insn == tf->eip){
+      tf->eip = e->fixup;
+      return 1;
+    }
+  }
+  return 0;
+}
+
 //PAGEBREAK!
 // Blank page.
 //PAGEBREAK!
@@ -0,0 +1,78 @@
+// Make small writes to files in parallel and report the ticks
+// taken.  Each writer appends to its own file, one small write
+// (one log transaction) at a time.  Every writer does the same
+// work, so the time should grow slowly as writers are added if
+// they can join a transaction while the last one commits.
+//
+// usage: writebench [writers]
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+#include "fsstat.h"
+
+#define NWRITE 200
+
+static char data[64];
+
+static void
+name(char *path, int i)
+{
+  strcpy(path, "writebench.0");
+  path[11] = '0' + i;
+}
+
+static void
+writer(int i)
+{
+  char path[16];
+  int fd, n;
+
+  name(path, i);
+  if((fd = open(path, O_CREATE|O_RDWR)) < 0){
+    printf(2, "writebench: cannot create %s\n", path);
+    exit();
+  }
+  for(n = 0; n < NWRITE; n++)
+    write(fd, data, sizeof(data));
+  close(fd);
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct fsstat st0, st1;
+  char path[16];
+  int i, j, n, t;
+
+  n = 4;
+  if(argc > 1)
+    n = atoi(argv[1]);
+  if(n <= 0 || n > 10){
+    printf(2, "usage: writebench [writers], at most 10\n");
+    exit();
+  }
+
+  for(i = 1; i <= n; i++){
+    fsstat(&st0);
+    t = uptime();
+    for(j = 0; j < i; j++){
+      if(fork() == 0){
+        writer(j);
+        exit();
+      }
+    }
+    for(j = 0; j < i; j++)
+      wait();
+    t = uptime() - t;
+    fsstat(&st1);
+    printf(1, "%d writers: %d ticks, %d commits\n", i, t,
+           st1.ncommit - st0.ncommit);
+    for(j = 0; j < i; j++){
+      name(path, j);
+      unlink(path);
+    }
+  }
+  exit();
+}